@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+
+uint64_t
+bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool
+bench_samples_init(struct bench_samples *samples, size_t size)
+{
+	samples->ns = calloc(size, sizeof(samples->ns[0]));
+	samples->size = size;
+	bench_samples_reset(samples);
+
+	return samples->ns != NULL;
+}
+
+void
+bench_samples_fini(struct bench_samples *samples)
+{
+	free(samples->ns);
+	samples->ns = NULL;
+	samples->size = 0;
+}
+
+void
+bench_samples_reset(struct bench_samples *samples)
+{
+	samples->n_samples = 0;
+	samples->calls = 0;
+	samples->total_ns = 0;
+}
+
+void
+bench_samples_add(struct bench_samples *samples, uint64_t ns,
+		  unsigned int calls)
+{
+	if (samples->n_samples < samples->size)
+		samples->ns[samples->n_samples++] = ns / calls;
+
+	samples->calls += calls;
+	samples->total_ns += ns;
+}
+
+static int
+bench_samples_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+uint64_t
+bench_samples_percentile(struct bench_samples *samples, unsigned int pct)
+{
+	size_t n = samples->n_samples;
+
+	if (n == 0)
+		return 0;
+
+	qsort(samples->ns, n, sizeof(samples->ns[0]), bench_samples_cmp);
+	return samples->ns[(n - 1) * pct / 100];
+}
+
+void
+bench_samples_print_json(struct bench_samples *samples, FILE *fp)
+{
+	double ops = 0;
+
+	if (samples->total_ns > 0)
+		ops = samples->calls * 1e9 / samples->total_ns;
+
+	fprintf(fp, "\"calls\": %"PRIu64", \"ops_per_sec\": %.0f, "
+		"\"p50_ns\": %"PRIu64", \"p99_ns\": %"PRIu64,
+		samples->calls, ops,
+		bench_samples_percentile(samples, 50),
+		bench_samples_percentile(samples, 99));
+}
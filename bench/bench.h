@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Timing helpers shared by the benchmarks. Each benchmark prints a single
+ * JSON object on stdout, such that runs can be compared with one another.
+ */
+
+/* per call latencies, for the percentiles; calls too short to be timed on
+ * their own are timed in batches, each batch giving one sample */
+struct bench_samples {
+	uint64_t *ns;
+	size_t n_samples;
+	size_t size;
+	uint64_t calls;
+	uint64_t total_ns;
+};
+
+uint64_t
+bench_now_ns(void);
+
+bool
+bench_samples_init(struct bench_samples *samples, size_t size);
+
+void
+bench_samples_fini(struct bench_samples *samples);
+
+void
+bench_samples_reset(struct bench_samples *samples);
+
+/* adds 'ns' spent on 'calls' calls; samples past the size given to
+ * bench_samples_init() are only counted in the totals */
+void
+bench_samples_add(struct bench_samples *samples, uint64_t ns,
+		  unsigned int calls);
+
+/* sorts the samples, so call it once all of them were added */
+uint64_t
+bench_samples_percentile(struct bench_samples *samples, unsigned int pct);
+
+/* prints "calls", "ops_per_sec", "p50_ns" and "p99_ns" members, the caller
+ * takes care of the braces around them */
+void
+bench_samples_print_json(struct bench_samples *samples, FILE *fp);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Looks up app_ids with ivi_find_app() among 10, 100 and 1000 surfaces,
+ * against a walk of the whole surface list, which is what ivi_find_app()
+ * used to do.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libweston/zalloc.h>
+
+#include "shared/helpers.h"
+#include "ivi-compositor.h"
+
+#include "bench.h"
+
+/* lookups timed together, a single one is too short for the clock */
+#define BATCH		256
+#define SAMPLES		4096
+
+static const size_t surface_counts[] = { 10, 100, 1000 };
+
+static struct ivi_surface *
+linear_find_app(struct ivi_compositor *ivi, const char *app_id)
+{
+	struct ivi_surface *surf;
+
+	/* the list walk used to go through the desktop surface, which
+	 * only made it slower */
+	wl_list_for_each(surf, &ivi->surfaces, link) {
+		if (surf->app_id && strcmp(app_id, surf->app_id) == 0)
+			return surf;
+	}
+
+	return NULL;
+}
+
+static void
+add_surfaces(struct ivi_compositor *ivi, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		struct ivi_surface *surf = zalloc(sizeof(*surf));
+		char app_id[64];
+
+		if (!surf)
+			abort();
+
+		snprintf(app_id, sizeof(app_id),
+			 "org.automotivelinux.app%04zu", i);
+
+		surf->ivi = ivi;
+		surf->app_id = strdup(app_id);
+		surf->app_id_hash = ivi_app_id_hash(surf->app_id);
+		wl_list_init(&surf->app_id_link);
+
+		wl_list_insert(&ivi->surfaces, &surf->link);
+		ivi_app_id_index_add(surf);
+	}
+}
+
+static void
+remove_surfaces(struct ivi_compositor *ivi)
+{
+	struct ivi_surface *surf, *tmp;
+
+	wl_list_for_each_safe(surf, tmp, &ivi->surfaces, link) {
+		ivi_app_id_index_remove(surf);
+		wl_list_remove(&surf->link);
+		free(surf->app_id);
+		free(surf);
+	}
+}
+
+static void
+run(struct ivi_compositor *ivi, char **app_ids, size_t count,
+    struct ivi_surface *(*find)(struct ivi_compositor *, const char *),
+    struct bench_samples *samples)
+{
+	size_t next = 0;
+
+	bench_samples_reset(samples);
+
+	for (int s = 0; s < SAMPLES; s++) {
+		uint64_t start = bench_now_ns();
+
+		for (int i = 0; i < BATCH; i++) {
+			if (!find(ivi, app_ids[next]))
+				abort();
+			next = (next + 1) % count;
+		}
+
+		bench_samples_add(samples, bench_now_ns() - start, BATCH);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ivi_compositor ivi = {};
+	struct bench_samples samples;
+	bool first = true;
+
+	wl_list_init(&ivi.surfaces);
+	for (size_t i = 0; i < ARRAY_LENGTH(ivi.app_ids); i++)
+		wl_list_init(&ivi.app_ids[i]);
+
+	if (!bench_samples_init(&samples, SAMPLES))
+		return EXIT_FAILURE;
+
+	srand(1);
+
+	printf("{\"benchmark\": \"find-app\", \"results\": [");
+
+	for (size_t c = 0; c < ARRAY_LENGTH(surface_counts); c++) {
+		size_t count = surface_counts[c];
+		struct ivi_surface *surf;
+		char **app_ids;
+		size_t i = 0;
+
+		add_surfaces(&ivi, count);
+
+		/* looked up in random order, such that the list walk isn't
+		 * always the best or the worst case */
+		app_ids = calloc(count, sizeof(*app_ids));
+		if (!app_ids)
+			return EXIT_FAILURE;
+		wl_list_for_each(surf, &ivi.surfaces, link)
+			app_ids[i++] = surf->app_id;
+		for (i = count - 1; i > 0; i--) {
+			size_t j = rand() % (i + 1);
+			char *tmp = app_ids[i];
+
+			app_ids[i] = app_ids[j];
+			app_ids[j] = tmp;
+		}
+
+		run(&ivi, app_ids, count, linear_find_app, &samples);
+		printf("%s\n  {\"surfaces\": %zu, \"lookup\": \"list\", ",
+		       first ? "" : ",", count);
+		bench_samples_print_json(&samples, stdout);
+		printf("}");
+		first = false;
+
+		run(&ivi, app_ids, count, ivi_find_app, &samples);
+		printf(",\n  {\"surfaces\": %zu, \"lookup\": \"hash\", ", count);
+		bench_samples_print_json(&samples, stdout);
+		printf("}");
+
+		free(app_ids);
+		remove_surfaces(&ivi);
+	}
+
+	printf("\n]}\n");
+
+	bench_samples_fini(&samples);
+	return EXIT_SUCCESS;
+}
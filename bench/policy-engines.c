@@ -0,0 +1,246 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Drives a policy engine, the one built in along with this file, through
+ * millions of surface_create and surface_activate hook calls, for a few
+ * sets of app_ids, and of state changes, for a few rule counts. Built once
+ * per engine, such that they can be compared with one another, as well as
+ * with their earlier selves.
+ *
+ * The rba engine arbitrates with the model it finds at its default path;
+ * without any, every activation is denied.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "shared/helpers.h"
+#include "ivi-compositor.h"
+#include "policy.h"
+
+#include "bench.h"
+#include "stub-compositor.h"
+
+/* hook calls timed together */
+#define BATCH		64
+#define HOOK_CALLS	(1 << 20)
+#define STATE_CHANGES	(1 << 18)
+#define STATES		16
+/* past the default states */
+#define FIRST_STATE	4
+
+static const size_t app_id_counts[] = { 16, 256 };
+static const size_t rule_counts[] = { 100, 10000 };
+
+/* the ones deny-all lets through by default, the rest made up */
+static const char * const known_app_ids[] = {
+	"homescreen", "alexa-viewer", "launcher",
+	"hvac", "navigation", "mediaplayer",
+};
+
+enum hook {
+	HOOK_SURFACE_CREATE,
+	HOOK_SURFACE_ACTIVATE,
+};
+
+static const char * const hook_names[] = {
+	[HOOK_SURFACE_CREATE] = "surface_create",
+	[HOOK_SURFACE_ACTIVATE] = "surface_activate",
+};
+
+static bool first_result = true;
+
+/* rules stay around until the policy goes away, so each rule count builds
+ * on the previous one */
+static size_t rules_added;
+
+static void
+print_result_start(const char *op)
+{
+	printf("%s\n  {\"op\": \"%s\", ", first_result ? "" : ",", op);
+	first_result = false;
+}
+
+static void
+print_result_end(struct bench_samples *samples)
+{
+	bench_samples_print_json(samples, stdout);
+	printf("}");
+}
+
+static void
+create_surfaces(struct bench_compositor *bc, struct ivi_surface **surfaces,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		char app_id[64];
+
+		if (i < ARRAY_LENGTH(known_app_ids))
+			snprintf(app_id, sizeof(app_id), "%s",
+				 known_app_ids[i]);
+		else
+			snprintf(app_id, sizeof(app_id),
+				 "org.automotivelinux.app%04zu", i);
+
+		surfaces[i] = bench_surface_create(bc, app_id);
+		if (!surfaces[i])
+			abort();
+	}
+}
+
+static void
+run_hook(struct bench_compositor *bc, enum hook hook,
+	 struct ivi_surface **surfaces, size_t count,
+	 struct bench_samples *samples)
+{
+	struct ivi_policy *policy = bc->ivi.policy;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(bc->compositor.wl_display);
+	bool (*func)(struct ivi_surface *surf, void *user_data);
+	uint64_t allowed = 0;
+	size_t next = 0;
+
+	switch (hook) {
+	case HOOK_SURFACE_CREATE:
+		func = policy->api.surface_create;
+		break;
+	case HOOK_SURFACE_ACTIVATE:
+		func = policy->api.surface_activate;
+		break;
+	default:
+		abort();
+	}
+
+	bench_samples_reset(samples);
+	if (!func)
+		goto out;
+
+	for (int s = 0; s < HOOK_CALLS / BATCH; s++) {
+		uint64_t start = bench_now_ns();
+
+		for (int i = 0; i < BATCH; i++) {
+			if (func(surfaces[next], policy->user_data))
+				allowed++;
+			next = (next + 1) % count;
+		}
+
+		bench_samples_add(samples, bench_now_ns() - start, BATCH);
+
+		/* verdicts coming back from an engine's own thread */
+		wl_event_loop_dispatch(loop, 0);
+	}
+
+out:
+	print_result_start(hook_names[hook]);
+	printf("\"app_ids\": %zu, \"allowed\": %"PRIu64", ", count, allowed);
+	print_result_end(samples);
+}
+
+static void
+run_state_changes(struct bench_compositor *bc, struct ivi_surface **surfaces,
+		  size_t n_surfaces, size_t count,
+		  struct bench_samples *samples)
+{
+	struct ivi_policy *policy = bc->ivi.policy;
+	uint64_t activations = bc->activations;
+
+	for (size_t i = rules_added; i < count; i++) {
+		if (ivi_policy_add(policy, surfaces[i % n_surfaces]->app_id,
+				   FIRST_STATE + i % STATES,
+				   AGL_SHELL_POLICY_EVENT_SHOW, 0, NULL) < 0)
+			break;
+		rules_added++;
+	}
+
+	bench_samples_reset(samples);
+	for (uint32_t i = 0; i < STATE_CHANGES; i++) {
+		uint64_t start = bench_now_ns();
+
+		ivi_policy_state_change(policy, FIRST_STATE + i % STATES);
+		bench_samples_add(samples, bench_now_ns() - start, 1);
+	}
+
+	print_result_start("state_change");
+	printf("\"rules\": %zu, \"states\": %d, \"activations\": %"PRIu64", ",
+	       rules_added, STATES, bc->activations - activations);
+	print_result_end(samples);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_compositor bc;
+	struct bench_samples samples;
+	struct ivi_surface **surfaces;
+	size_t max_app_ids = 0;
+
+	for (size_t c = 0; c < ARRAY_LENGTH(app_id_counts); c++)
+		max_app_ids = MAX(max_app_ids, app_id_counts[c]);
+
+	surfaces = calloc(max_app_ids, sizeof(*surfaces));
+	if (!surfaces ||
+	    !bench_samples_init(&samples, MAX(HOOK_CALLS / BATCH,
+					      STATE_CHANGES)) ||
+	    !bench_compositor_init(&bc))
+		return EXIT_FAILURE;
+
+	if (ivi_policy_init(&bc.ivi) < 0)
+		return EXIT_FAILURE;
+
+	for (uint32_t s = 0; s < STATES; s++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "state%u", s);
+		ivi_policy_add_state(bc.ivi.policy, FIRST_STATE + s, name);
+	}
+
+	printf("{\"benchmark\": \"policy\", \"engine\": \"%s\", "
+	       "\"results\": [", BENCH_POLICY_ENGINE);
+
+	for (size_t c = 0; c < ARRAY_LENGTH(app_id_counts); c++) {
+		size_t count = app_id_counts[c];
+
+		create_surfaces(&bc, surfaces, count);
+		run_hook(&bc, HOOK_SURFACE_CREATE, surfaces, count, &samples);
+		run_hook(&bc, HOOK_SURFACE_ACTIVATE, surfaces, count, &samples);
+		for (size_t i = 0; i < count; i++)
+			bench_surface_destroy(surfaces[i]);
+	}
+
+	create_surfaces(&bc, surfaces, max_app_ids);
+	for (size_t c = 0; c < ARRAY_LENGTH(rule_counts); c++)
+		run_state_changes(&bc, surfaces, max_app_ids, rule_counts[c],
+				  &samples);
+	for (size_t i = 0; i < max_app_ids; i++)
+		bench_surface_destroy(surfaces[i]);
+
+	printf("\n]}\n");
+
+	bench_compositor_fini(&bc);
+	bench_samples_fini(&samples);
+	free(surfaces);
+	return EXIT_SUCCESS;
+}
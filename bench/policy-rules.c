@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Adds 100, 1000 and 10000 policy rules spread over 64 states, and times
+ * ivi_policy_add() and the state changes going over them: with the rules
+ * bucketed by state, a state change only goes over the rules of the new
+ * state, while walking all the rules, as state changes used to do, grows
+ * with the total number of rules.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "shared/helpers.h"
+#include "ivi-compositor.h"
+#include "policy.h"
+
+#include "bench.h"
+#include "stub-compositor.h"
+
+#define STATES		64
+/* past the default states */
+#define FIRST_STATE	4
+#define STATE_CHANGES	(1 << 16)
+
+static const size_t rule_counts[] = { 100, 1000, 10000 };
+
+static uint64_t events;
+
+static void
+count_event(struct ivi_a_policy *a_policy)
+{
+	events++;
+}
+
+static const struct ivi_policy_api policy_api = {
+	.struct_size = sizeof(policy_api),
+	.policy_rule_try_event = count_event,
+};
+
+/* what ivi_policy_check_policies() used to do */
+static void
+list_check_policies(struct wl_listener *listener, void *data)
+{
+	struct ivi_policy *policy = data;
+	struct ivi_a_policy *a_policy;
+
+	policy->state_change_in_progress = true;
+	wl_list_for_each(a_policy, &policy->policies, link)
+		if (policy->current_state == a_policy->state)
+			policy->api.policy_rule_try_event(a_policy);
+
+	policy->previous_state = policy->current_state;
+	policy->state_change_in_progress = false;
+}
+
+static struct ivi_policy *
+create_policy(struct bench_compositor *bc, size_t count,
+	      struct bench_samples *samples)
+{
+	struct ivi_policy *policy;
+
+	policy = ivi_policy_create(&bc->ivi, &policy_api, NULL);
+	if (!policy)
+		abort();
+
+	for (uint32_t s = 0; s < STATES; s++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "state%u", s);
+		ivi_policy_add_state(policy, FIRST_STATE + s, name);
+	}
+
+	bench_samples_reset(samples);
+	for (size_t i = 0; i < count; i++) {
+		char app_id[64];
+		uint64_t start;
+
+		snprintf(app_id, sizeof(app_id),
+			 "org.automotivelinux.app%04zu", i);
+
+		start = bench_now_ns();
+		if (ivi_policy_add(policy, app_id, FIRST_STATE + i % STATES,
+				   AGL_SHELL_POLICY_EVENT_SHOW, 0, NULL) < 0)
+			abort();
+		bench_samples_add(samples, bench_now_ns() - start, 1);
+	}
+
+	return policy;
+}
+
+static void
+run(struct ivi_policy *policy, size_t count, struct bench_samples *samples)
+{
+	events = 0;
+	bench_samples_reset(samples);
+
+	for (uint32_t i = 0; i < STATE_CHANGES; i++) {
+		uint64_t start = bench_now_ns();
+
+		if (ivi_policy_state_change(policy,
+					    FIRST_STATE + i % STATES) < 0)
+			abort();
+		bench_samples_add(samples, bench_now_ns() - start, 1);
+	}
+
+	/* every rule got to run once per time around the states */
+	if (events != (uint64_t) count * (STATE_CHANGES / STATES))
+		abort();
+}
+
+static void
+print_result(size_t count, const char *op, const char *rules,
+	     struct bench_samples *samples, bool first)
+{
+	printf("%s\n  {\"rules\": %zu, \"op\": \"%s\", \"lookup\": \"%s\", ",
+	       first ? "" : ",", count, op, rules);
+	bench_samples_print_json(samples, stdout);
+	printf("}");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_compositor bc;
+	struct bench_samples samples;
+	size_t max_samples = STATE_CHANGES;
+
+	for (size_t c = 0; c < ARRAY_LENGTH(rule_counts); c++)
+		max_samples = MAX(max_samples, rule_counts[c]);
+
+	if (!bench_compositor_init(&bc) ||
+	    !bench_samples_init(&samples, max_samples))
+		return EXIT_FAILURE;
+
+	printf("{\"benchmark\": \"policy-rules\", \"states\": %d, "
+	       "\"results\": [", STATES);
+
+	for (size_t c = 0; c < ARRAY_LENGTH(rule_counts); c++) {
+		size_t count = rule_counts[c];
+		struct ivi_policy *policy;
+
+		policy = create_policy(&bc, count, &samples);
+		print_result(count, "add", "bitset", &samples, c == 0);
+
+		run(policy, count, &samples);
+		print_result(count, "state_change", "bucket", &samples, false);
+
+		policy->listener_check_policies.notify = list_check_policies;
+		run(policy, count, &samples);
+		print_result(count, "state_change", "list", &samples, false);
+
+		ivi_policy_destroy(policy);
+	}
+
+	printf("\n]}\n");
+
+	bench_samples_fini(&samples);
+	bench_compositor_fini(&bc);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Stitches four 1920x1080 outputs into a 3840x2160 image, in each of the
+ * formats agl-screenshooter writes out, converting the pixels of the
+ * outputs straight into their place in the image, against copying them
+ * row by row into a composite first, as agl-screenshooter used to, and
+ * converting that when the format isn't the one of the outputs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/helpers.h"
+#include "clients/screenshot-convert.h"
+
+#include "bench.h"
+
+#define OUTPUT_WIDTH	1920
+#define OUTPUT_HEIGHT	1080
+#define WIDTH		(2 * OUTPUT_WIDTH)
+#define HEIGHT		(2 * OUTPUT_HEIGHT)
+#define SAMPLES		32
+
+struct format {
+	const char *name;
+	int bpp;
+	void (*convert_row)(void *dst, const uint32_t *src, int n);
+};
+
+static const struct format formats[] = {
+	{ "argb32", 4, screenshot_convert_row_argb32 },
+	{ "rgb24", 4, screenshot_convert_row_rgb24 },
+	{ "rgb565", 2, screenshot_convert_row_rgb565 },
+};
+
+/* the shm buffers of the outputs */
+static uint32_t *outputs[4];
+
+static void
+stitch(uint8_t *image, const struct format *format, int o)
+{
+	int x = (o % 2) * OUTPUT_WIDTH;
+	int y = (o / 2) * OUTPUT_HEIGHT;
+	int stride = WIDTH * format->bpp;
+	uint8_t *d = image + y * stride + x * format->bpp;
+	const uint32_t *s = outputs[o];
+
+	for (int i = 0; i < OUTPUT_HEIGHT; i++) {
+		format->convert_row(d, s, OUTPUT_WIDTH);
+		d += stride;
+		s += OUTPUT_WIDTH;
+	}
+}
+
+static uint8_t *
+fused(const struct format *format)
+{
+	uint8_t *image = malloc(WIDTH * HEIGHT * format->bpp);
+
+	if (!image)
+		abort();
+
+	for (size_t o = 0; o < ARRAY_LENGTH(outputs); o++)
+		stitch(image, format, o);
+
+	return image;
+}
+
+static uint8_t *
+memcpy_then_convert(const struct format *format)
+{
+	uint8_t *composite = malloc(WIDTH * HEIGHT * 4);
+	uint8_t *image;
+
+	if (!composite)
+		abort();
+
+	for (size_t o = 0; o < ARRAY_LENGTH(outputs); o++) {
+		int x = (o % 2) * OUTPUT_WIDTH;
+		int y = (o / 2) * OUTPUT_HEIGHT;
+		const uint32_t *s = outputs[o];
+
+		for (int i = 0; i < OUTPUT_HEIGHT; i++) {
+			memcpy(composite + ((y + i) * WIDTH + x) * 4,
+			       s + i * OUTPUT_WIDTH, OUTPUT_WIDTH * 4);
+		}
+	}
+
+	/* handed over to cairo as is */
+	if (format->convert_row == screenshot_convert_row_argb32)
+		return composite;
+
+	image = malloc(WIDTH * HEIGHT * format->bpp);
+	if (!image)
+		abort();
+
+	for (int i = 0; i < HEIGHT; i++)
+		format->convert_row(image + i * WIDTH * format->bpp,
+				    (const uint32_t *) composite + i * WIDTH,
+				    WIDTH);
+	free(composite);
+
+	return image;
+}
+
+static void
+run(const struct format *format, const char *path,
+    uint8_t *(*func)(const struct format *format),
+    struct bench_samples *samples, bool first)
+{
+	bench_samples_reset(samples);
+
+	for (int s = 0; s < SAMPLES; s++) {
+		uint64_t start = bench_now_ns();
+		uint8_t *image = func(format);
+
+		bench_samples_add(samples, bench_now_ns() - start, 1);
+		free(image);
+	}
+
+	printf("%s\n  {\"format\": \"%s\", \"path\": \"%s\", ",
+	       first ? "" : ",", format->name, path);
+	bench_samples_print_json(samples, stdout);
+	printf("}");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_samples samples;
+	uint32_t seed = 1;
+
+	if (!bench_samples_init(&samples, SAMPLES))
+		return EXIT_FAILURE;
+
+	/* the X byte is whatever the renderer left there */
+	for (size_t o = 0; o < ARRAY_LENGTH(outputs); o++) {
+		outputs[o] = malloc(OUTPUT_WIDTH * OUTPUT_HEIGHT * 4);
+		if (!outputs[o])
+			return EXIT_FAILURE;
+
+		for (int i = 0; i < OUTPUT_WIDTH * OUTPUT_HEIGHT; i++) {
+			seed = seed * 1664525 + 1013904223;
+			outputs[o][i] = seed;
+		}
+	}
+
+	printf("{\"benchmark\": \"stitch\", \"width\": %d, \"height\": %d, "
+	       "\"outputs\": %zu, \"results\": [", WIDTH, HEIGHT,
+	       ARRAY_LENGTH(outputs));
+
+	for (size_t f = 0; f < ARRAY_LENGTH(formats); f++) {
+		const struct format *format = &formats[f];
+		uint8_t *a = fused(format);
+		uint8_t *b = memcpy_then_convert(format);
+
+		/* both ways have to come up with the same image */
+		if (memcmp(a, b, WIDTH * HEIGHT * format->bpp) != 0)
+			return EXIT_FAILURE;
+		free(a);
+		free(b);
+
+		run(format, "memcpy", memcpy_then_convert, &samples, f == 0);
+		run(format, "fused", fused, &samples, false);
+	}
+
+	printf("\n]}\n");
+
+	for (size_t o = 0; o < ARRAY_LENGTH(outputs); o++)
+		free(outputs[o]);
+	bench_samples_fini(&samples);
+	return EXIT_SUCCESS;
+}
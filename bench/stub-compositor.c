@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libweston/zalloc.h>
+
+#include "policy.h"
+#include "stub-compositor.h"
+
+/* the one the stubs below act on */
+static struct bench_compositor *bench_compositor;
+
+/* all we need from the client side of a surface */
+struct weston_desktop_surface {
+	char *app_id;
+};
+
+bool
+bench_compositor_init(struct bench_compositor *bc)
+{
+	memset(bc, 0, sizeof(*bc));
+
+	bc->compositor.wl_display = wl_display_create();
+	if (!bc->compositor.wl_display)
+		return false;
+	wl_signal_init(&bc->compositor.destroy_signal);
+
+	bc->ivi.compositor = &bc->compositor;
+	wl_list_init(&bc->ivi.outputs);
+	wl_list_init(&bc->ivi.surfaces);
+	wl_list_init(&bc->ivi.pending_surfaces);
+	for (size_t i = 0; i < IVI_APP_ID_HASH_SIZE; i++)
+		wl_list_init(&bc->ivi.app_ids[i]);
+
+	bc->output.ivi = &bc->ivi;
+	bc->output.name = "bench";
+	wl_list_init(&bc->output.mru);
+	wl_list_insert(&bc->ivi.outputs, &bc->output.link);
+
+	bench_compositor = bc;
+	return true;
+}
+
+void
+bench_compositor_fini(struct bench_compositor *bc)
+{
+	wl_signal_emit(&bc->compositor.destroy_signal, &bc->compositor);
+
+	if (bc->ivi.policy)
+		ivi_policy_destroy(bc->ivi.policy);
+
+	wl_display_destroy(bc->compositor.wl_display);
+	bench_compositor = NULL;
+}
+
+struct ivi_surface *
+bench_surface_create(struct bench_compositor *bc, const char *app_id)
+{
+	struct ivi_surface *surf;
+
+	surf = zalloc(sizeof(*surf));
+	if (!surf)
+		return NULL;
+
+	surf->dsurface = zalloc(sizeof(*surf->dsurface));
+	if (!surf->dsurface) {
+		free(surf);
+		return NULL;
+	}
+
+	surf->ivi = &bc->ivi;
+	surf->role = IVI_SURFACE_ROLE_DESKTOP;
+	surf->dsurface->app_id = strdup(app_id);
+	surf->app_id = strdup(app_id);
+	surf->desktop.last_output = &bc->output;
+	surf->activate_output = &bc->output;
+	wl_list_init(&surf->app_id_link);
+	wl_list_insert(&bc->ivi.surfaces, &surf->link);
+
+	return surf;
+}
+
+void
+bench_surface_destroy(struct ivi_surface *surf)
+{
+	wl_list_remove(&surf->link);
+	free(surf->dsurface->app_id);
+	free(surf->dsurface);
+	free(surf->app_id);
+	free(surf);
+}
+
+/* libweston */
+
+int
+weston_log(const char *fmt, ...)
+{
+	return 0;
+}
+
+int
+weston_vlog(const char *fmt, va_list ap)
+{
+	return 0;
+}
+
+int
+weston_log_scope_printf(struct weston_log_scope *scope, const char *fmt, ...)
+{
+	return 0;
+}
+
+bool
+weston_view_is_mapped(struct weston_view *view)
+{
+	return false;
+}
+
+const char *
+weston_desktop_surface_get_app_id(struct weston_desktop_surface *dsurface)
+{
+	return dsurface->app_id;
+}
+
+struct weston_head *
+weston_head_from_resource(struct wl_resource *resource)
+{
+	return NULL;
+}
+
+struct weston_output *
+weston_head_get_output(struct weston_head *head)
+{
+	return NULL;
+}
+
+/* there's no configuration, everything takes the default value */
+struct weston_config_section *
+weston_config_get_section(struct weston_config *config, const char *section,
+			  const char *key, const char *value)
+{
+	return NULL;
+}
+
+int
+weston_config_section_get_string(struct weston_config_section *section,
+				 const char *key, char **value,
+				 const char *default_value)
+{
+	*value = default_value ? strdup(default_value) : NULL;
+	errno = ENOENT;
+	return -1;
+}
+
+int
+weston_config_section_get_bool(struct weston_config_section *section,
+			       const char *key, bool *value,
+			       bool default_value)
+{
+	*value = default_value;
+	errno = ENOENT;
+	return -1;
+}
+
+/* agl-compositor */
+
+struct ivi_output *
+to_ivi_output(struct weston_output *o)
+{
+	return &bench_compositor->output;
+}
+
+struct ivi_surface *
+ivi_find_app(struct ivi_compositor *ivi, const char *app_id)
+{
+	struct ivi_surface *surf;
+
+	wl_list_for_each(surf, &ivi->surfaces, link)
+		if (strcmp(surf->app_id, app_id) == 0)
+			return surf;
+
+	return NULL;
+}
+
+struct ivi_output *
+ivi_layout_get_output_from_surface(struct ivi_surface *surf)
+{
+	return &bench_compositor->output;
+}
+
+void
+ivi_layout_activate_by_surf(struct ivi_output *output,
+			    struct ivi_surface *surf)
+{
+	bench_compositor->activations++;
+}
+
+void
+ivi_layout_activate(struct ivi_output *output, const char *app_id)
+{
+	bench_compositor->activations++;
+}
+
+void
+ivi_layout_deactivate(struct ivi_compositor *ivi, const char *app_id)
+{
+	bench_compositor->deactivations++;
+}
+
+void
+ivi_layout_set_position(struct ivi_surface *surface, int32_t x, int32_t y,
+			int32_t width, int32_t height)
+{
+}
+
+void
+ivi_layout_set_mapped(struct ivi_surface *surface)
+{
+}
+
+void
+ivi_layout_set_unmapped(struct ivi_surface *surface)
+{
+}
+
+void
+ivi_layout_commit(struct ivi_compositor *ivi)
+{
+}
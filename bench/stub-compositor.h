@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BENCH_STUB_COMPOSITOR_H
+#define BENCH_STUB_COMPOSITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ivi-compositor.h"
+
+/*
+ * A compositor with a single output and no backend, renderer or clients,
+ * enough to run the policy code on its own. The libweston and
+ * agl-compositor functions the policy code calls are replaced by the ones
+ * in stub-compositor.c, so nothing else needs to be linked in.
+ *
+ * Every wl_output resource stands for the one output, and the layout only
+ * counts what it is asked to do.
+ */
+struct bench_compositor {
+	struct ivi_compositor ivi;
+	struct weston_compositor compositor;
+	struct ivi_output output;
+
+	uint64_t activations;
+	uint64_t deactivations;
+};
+
+bool
+bench_compositor_init(struct bench_compositor *bc);
+
+void
+bench_compositor_fini(struct bench_compositor *bc);
+
+/* a desktop surface of the one output, with the given app_id */
+struct ivi_surface *
+bench_surface_create(struct bench_compositor *bc, const char *app_id);
+
+void
+bench_surface_destroy(struct ivi_surface *surf);
+
+#endif
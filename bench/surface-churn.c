@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Creates and destroys thousands of surfaces, going through the same
+ * bookkeeping as desktop_surface_added()/desktop_surface_removed(), and
+ * times the removals: with the per-role counters their cost doesn't depend
+ * on the number of surfaces, while counting the surfaces of a role by
+ * walking the list, as removals used to do, grows with it.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libweston/zalloc.h>
+
+#include "shared/helpers.h"
+#include "ivi-compositor.h"
+
+#include "bench.h"
+
+/* removals timed together */
+#define BATCH		64
+#define ROUNDS		8
+
+static const size_t surface_counts[] = { 1000, 2000, 4000, 8000 };
+
+/* what clients usually end up with */
+static const enum ivi_surface_role roles[] = {
+	IVI_SURFACE_ROLE_DESKTOP,
+	IVI_SURFACE_ROLE_DESKTOP,
+	IVI_SURFACE_ROLE_DESKTOP,
+	IVI_SURFACE_ROLE_REMOTE,
+	IVI_SURFACE_ROLE_SPLIT_V,
+	IVI_SURFACE_ROLE_FULLSCREEN,
+};
+
+static bool
+list_is_last_of_role(struct ivi_compositor *ivi, enum ivi_surface_role role)
+{
+	struct ivi_surface *surf;
+	int count = 0;
+
+	wl_list_for_each(surf, &ivi->surfaces, link)
+		if (surf->role == role)
+			count++;
+
+	return count == 1;
+}
+
+static bool
+counter_is_last_of_role(struct ivi_compositor *ivi, enum ivi_surface_role role)
+{
+	return ivi->role_count[role] == 1;
+}
+
+static void
+add_surfaces(struct ivi_compositor *ivi, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		struct ivi_surface *surf = zalloc(sizeof(*surf));
+		char app_id[64];
+
+		if (!surf)
+			abort();
+
+		snprintf(app_id, sizeof(app_id),
+			 "org.automotivelinux.app%04zu", i);
+
+		surf->ivi = ivi;
+		surf->role = roles[i % ARRAY_LENGTH(roles)];
+		surf->app_id = strdup(app_id);
+		surf->app_id_hash = ivi_app_id_hash(surf->app_id);
+		wl_list_init(&surf->app_id_link);
+
+		wl_list_insert(&ivi->surfaces, &surf->link);
+		ivi_app_id_index_add(surf);
+		ivi_surface_role_track(surf);
+	}
+}
+
+static size_t
+remove_surface(struct ivi_compositor *ivi, struct ivi_surface *surf,
+	       bool (*is_last_of_role)(struct ivi_compositor *,
+				       enum ivi_surface_role))
+{
+	size_t last = 0;
+
+	if (is_last_of_role(ivi, IVI_SURFACE_ROLE_REMOTE) ||
+	    is_last_of_role(ivi, IVI_SURFACE_ROLE_DESKTOP))
+		last++;
+
+	wl_list_remove(&surf->link);
+	ivi_app_id_index_remove(surf);
+	ivi_surface_role_untrack(surf);
+
+	free(surf->app_id);
+	free(surf);
+
+	return last;
+}
+
+/* returns how many removals found a single surface left of either role, to
+ * check both ways agree */
+static size_t
+run(struct ivi_compositor *ivi, size_t count,
+    bool (*is_last_of_role)(struct ivi_compositor *, enum ivi_surface_role),
+    struct bench_samples *samples, uint64_t *teardown_ns)
+{
+	size_t last = 0;
+
+	bench_samples_reset(samples);
+	*teardown_ns = 0;
+
+	for (int r = 0; r < ROUNDS; r++) {
+		uint64_t teardown_start;
+
+		add_surfaces(ivi, count);
+
+		teardown_start = bench_now_ns();
+		while (!wl_list_empty(&ivi->surfaces)) {
+			uint64_t start = bench_now_ns();
+			int i;
+
+			for (i = 0; i < BATCH && !wl_list_empty(&ivi->surfaces);
+			     i++) {
+				struct ivi_surface *surf =
+					wl_container_of(ivi->surfaces.next,
+							surf, link);
+
+				last += remove_surface(ivi, surf,
+						       is_last_of_role);
+			}
+
+			bench_samples_add(samples, bench_now_ns() - start, i);
+		}
+		*teardown_ns += bench_now_ns() - teardown_start;
+	}
+
+	*teardown_ns /= ROUNDS;
+	return last;
+}
+
+static void
+print_result(size_t count, const char *lookup, struct bench_samples *samples,
+	     uint64_t teardown_ns, bool first)
+{
+	printf("%s\n  {\"surfaces\": %zu, \"role_count\": \"%s\", "
+	       "\"teardown_ns\": %"PRIu64", ", first ? "" : ",",
+	       count, lookup, teardown_ns);
+	bench_samples_print_json(samples, stdout);
+	printf("}");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ivi_compositor ivi = {};
+	struct bench_samples samples;
+	size_t max_samples = 0;
+
+	wl_list_init(&ivi.surfaces);
+	for (size_t i = 0; i < ARRAY_LENGTH(ivi.app_ids); i++)
+		wl_list_init(&ivi.app_ids[i]);
+
+	for (size_t c = 0; c < ARRAY_LENGTH(surface_counts); c++)
+		max_samples = MAX(max_samples, surface_counts[c]);
+	if (!bench_samples_init(&samples, ROUNDS * max_samples / BATCH + ROUNDS))
+		return EXIT_FAILURE;
+
+	printf("{\"benchmark\": \"surface-churn\", \"results\": [");
+
+	for (size_t c = 0; c < ARRAY_LENGTH(surface_counts); c++) {
+		size_t count = surface_counts[c];
+		uint64_t teardown_ns;
+		size_t last;
+
+		last = run(&ivi, count, list_is_last_of_role, &samples,
+			   &teardown_ns);
+		print_result(count, "list", &samples, teardown_ns, c == 0);
+
+		if (run(&ivi, count, counter_is_last_of_role, &samples,
+			&teardown_ns) != last)
+			abort();
+		print_result(count, "counter", &samples, teardown_ns, false);
+	}
+
+	printf("\n]}\n");
+
+	bench_samples_fini(&samples);
+	return EXIT_SUCCESS;
+}
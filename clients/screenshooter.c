@@ -34,6 +34,9 @@
 #include <sys/param.h>
 #include <sys/mman.h>
 #include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <cairo.h>
 
 #include <wayland-client.h>
@@ -41,10 +44,35 @@
 #include "shared/xalloc.h"
 #include "shared/file-util.h"
 #include "shared/os-compatibility.h"
+#include "screenshot-convert.h"
 #include "agl-screenshooter-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
 
 struct screenshooter_data;
+struct screenshot_capture;
+
+/* pixel format of the images written out */
+struct screenshot_format {
+	const char *name;
+	cairo_format_t cairo_format;
+	int bpp;
+	void (*convert_row)(void *dst, const uint32_t *src, int n);
+};
+
+struct screenshot_job {
+	void (*run)(struct screenshot_job *job);
+	struct wl_list link;	/** screenshot_pool::jobs */
+};
+
+struct screenshot_pool {
+	pthread_t *threads;
+	int n_threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct wl_list jobs;	/** screenshot_job::link */
+	bool finishing;
+};
 
 struct screenshooter_output {
 	struct wl_output *output;
@@ -54,6 +82,12 @@ struct screenshooter_output {
 	void *data;
 	struct screenshooter_data *sh_data;
 
+	/* when shooting all the outputs at once */
+	struct agl_screenshooter *screenshooter;
+	struct screenshot_capture *capture;
+	struct screenshot_job job;
+	char filepath[PATH_MAX];
+
 	struct wl_list link;	/** screenshooter_data::output_list */
 };
 
@@ -79,9 +113,86 @@ struct screenshooter_data {
 	struct wl_list output_list;	/** screenshooter_output::link */
 	struct wl_list xdg_output_list;	/** xdg_output_v1_info::link */
 
+	struct wl_registry *registry;
 	struct zxdg_output_manager_v1 *xdg_output_manager;
 	struct agl_screenshooter *screenshooter;
+	uint32_t screenshooter_name;
+	uint32_t screenshooter_version;
 	int buffer_copy_done;
+	uint32_t status;
+
+	const struct screenshot_format *format;
+};
+
+#define RING_BUFFERS	4
+
+struct screenshot_capture {
+	struct screenshot_pool pool;
+	struct buffer_size buff_size;
+	/* combined image, or NULL for one image per output */
+	cairo_surface_t *surface;
+
+	int pending;
+	bool failed;
+};
+
+struct screenshooter_region {
+	int x, y, width, height;
+};
+
+struct screenshooter_ring_capture;
+
+/* a frame being written out, which keeps its slot busy until then */
+struct screenshooter_ring_frame {
+	struct screenshooter_ring_capture *capture;
+	uint32_t slot;
+	struct screenshot_job job;
+	char filepath[PATH_MAX];
+};
+
+struct screenshooter_ring_capture {
+	struct screenshooter_output *output;
+	struct agl_screenshooter_ring *ring;
+	struct screenshot_pool pool;
+
+	struct wl_buffer *buffers[RING_BUFFERS];
+	void *data[RING_BUFFERS];
+	struct screenshooter_ring_frame frames[RING_BUFFERS];
+
+	int frames_left;
+	uint32_t dropped;
+	bool stopped;
+};
+
+/* What --stream writes for every frame: this header, then 'n_rects'
+ * struct stream_rect, then the pixels of each of those rectangles in turn,
+ * row after row, in XRGB8888. The first frame covers the whole output. */
+#define STREAM_MAGIC	0x534c4741	/* "AGLS" */
+
+struct stream_frame_header {
+	uint32_t magic;
+	uint32_t width, height;
+	uint32_t n_rects;
+	uint64_t tv_sec;
+	uint32_t tv_nsec;
+	uint32_t reserved;
+};
+
+struct stream_rect {
+	int32_t x, y, width, height;
+};
+
+struct screenshooter_stream_capture {
+	struct screenshooter_output *output;
+	struct agl_screenshooter_stream *stream;
+	struct wl_buffer *buffer;
+	void *data;
+	FILE *fp;
+
+	struct stream_rect *rects;
+	uint32_t n_rects, max_rects;
+
+	int done;
 };
 
 static int opts = 0x0;
@@ -89,6 +200,10 @@ static int opts = 0x0;
 #define OPT_SCREENSHOT_OUTPUT		1
 #define OPT_SHOW_ALL_OUTPUTS		2
 #define OPT_SCREENSHOT_ALL_OUTPUTS	3
+#define OPT_SCREENSHOT_RING		4
+#define OPT_SCREENSHOT_REGION		5
+#define OPT_SCREENSHOT_STREAM		6
+#define OPT_SCREENSHOT_EACH_OUTPUT	7
 
 static void
 display_handle_geometry(void *data,
@@ -218,6 +333,7 @@ screenshot_done(void *data, struct agl_screenshooter *screenshooter, uint32_t st
 {
 	struct screenshooter_data *sh_data = data;
 	sh_data->buffer_copy_done = 1;
+	sh_data->status = status;
 }
 
 static const struct agl_screenshooter_listener screenshooter_listener = {
@@ -244,8 +360,11 @@ handle_global(void *data, struct wl_registry *registry,
 	} else if (strcmp(interface, "wl_shm") == 0) {
 		sh_data->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
 	} else if (strcmp(interface, "agl_screenshooter") == 0) {
+		sh_data->screenshooter_name = name;
+		sh_data->screenshooter_version = MIN(version, 5);
 		sh_data->screenshooter = wl_registry_bind(registry, name,
-							  &agl_screenshooter_interface, 1);
+							  &agl_screenshooter_interface,
+							  sh_data->screenshooter_version);
 
 		agl_screenshooter_add_listener(sh_data->screenshooter,
 					       &screenshooter_listener, sh_data);
@@ -303,96 +422,101 @@ screenshot_create_shm_buffer(int width, int height, void **data_out,
 	return buffer;
 }
 
-static void
-screenshot_write_png_per_output(const struct buffer_size *buff_size,
-				struct screenshooter_output *sh_output)
+static int
+screenshot_create_file(char *filepath, size_t len)
 {
-	int output_stride, buffer_stride, i;
-	cairo_surface_t *surface;
-	void *data, *d, *s;
 	FILE *fp;
-	char filepath[PATH_MAX];
 
-	buffer_stride = buff_size->width * 4;
-	data = xmalloc(buffer_stride * buff_size->height);
-	if (!data)
-		return;
+	fp = file_create_dated(getenv("XDG_PICTURES_DIR"), "agl-screenshot-",
+			       ".png", filepath, len);
+	if (!fp)
+		return -1;
 
-	output_stride = sh_output->width * 4;
-	s = sh_output->data;
-	d = data + (sh_output->offset_y - buff_size->min_y) * buffer_stride +
-		   (sh_output->offset_x - buff_size->min_x) * 4;
+	fclose(fp);
+	return 0;
+}
 
-	for (i = 0; i < sh_output->height; i++) {
-		memcpy(d, s, output_stride);
-		d += buffer_stride;
-		s += output_stride;
-	}
+static const struct screenshot_format screenshot_formats[] = {
+	{ "argb32", CAIRO_FORMAT_ARGB32, 4, screenshot_convert_row_argb32 },
+	{ "rgb24", CAIRO_FORMAT_RGB24, 4, screenshot_convert_row_rgb24 },
+	{ "rgb565", CAIRO_FORMAT_RGB16_565, 2, screenshot_convert_row_rgb565 },
+};
+
+static const struct screenshot_format *
+screenshot_format_from_name(const char *name)
+{
+	size_t i;
 
-	surface = cairo_image_surface_create_for_data(data,
-						      CAIRO_FORMAT_ARGB32,
-						      buff_size->width,
-						      buff_size->height,
-						      buffer_stride);
+	for (i = 0; i < ARRAY_LENGTH(screenshot_formats); i++)
+		if (strcmp(screenshot_formats[i].name, name) == 0)
+			return &screenshot_formats[i];
 
-	fp = file_create_dated(getenv("XDG_PICTURES_DIR"), "agl-screenshot-",
-			       ".png", filepath, sizeof(filepath));
-	if (fp) {
-		fclose(fp);
-		cairo_surface_write_to_png(surface, filepath);
+	return NULL;
+}
+
+/* Converts the pixels of an output straight into their place in the image,
+ * at (x, y). */
+static void
+screenshot_stitch(cairo_surface_t *surface,
+		  const struct screenshot_format *format,
+		  const void *pixels, int width, int height, int x, int y)
+{
+	int stride = cairo_image_surface_get_stride(surface);
+	uint8_t *d = cairo_image_surface_get_data(surface);
+	const uint32_t *s = pixels;
+	int i;
+
+	d += y * stride + x * format->bpp;
+	for (i = 0; i < height; i++) {
+		format->convert_row(d, s, width);
+		d += stride;
+		s += width;
 	}
+}
 
+static void
+screenshot_write_png_surface(cairo_surface_t *surface, const char *filepath)
+{
+	cairo_surface_mark_dirty(surface);
+	cairo_surface_write_to_png(surface, filepath);
 	cairo_surface_destroy(surface);
-	free(data);
 }
 
 static void
-screenshot_write_png(const struct buffer_size *buff_size,
-		     struct wl_list *output_list)
+screenshot_write_png_data(const struct screenshot_format *format,
+			  void *data, int width, int height,
+			  const char *filepath)
 {
-	int output_stride, buffer_stride, i;
 	cairo_surface_t *surface;
-	void *data, *d, *s;
-	struct screenshooter_output *output, *next;
-	FILE *fp;
-	char filepath[PATH_MAX];
 
-	buffer_stride = buff_size->width * 4;
-
-	data = xmalloc(buffer_stride * buff_size->height);
-	if (!data)
+	/* nothing to convert, hand the shm buffer over to cairo as is */
+	if (format->convert_row == screenshot_convert_row_argb32) {
+		surface = cairo_image_surface_create_for_data(data,
+							      CAIRO_FORMAT_ARGB32,
+							      width, height,
+							      width * 4);
+		screenshot_write_png_surface(surface, filepath);
 		return;
-
-	wl_list_for_each_safe(output, next, output_list, link) {
-		output_stride = output->width * 4;
-		s = output->data;
-		d = data + (output->offset_y - buff_size->min_y) * buffer_stride +
-			   (output->offset_x - buff_size->min_x) * 4;
-
-		for (i = 0; i < output->height; i++) {
-			memcpy(d, s, output_stride);
-			d += buffer_stride;
-			s += output_stride;
-		}
-
-		free(output);
 	}
 
-	surface = cairo_image_surface_create_for_data(data,
-						      CAIRO_FORMAT_ARGB32,
-						      buff_size->width,
-						      buff_size->height,
-						      buffer_stride);
-
-	fp = file_create_dated(getenv("XDG_PICTURES_DIR"), "agl-screenshot-",
-			       ".png", filepath, sizeof(filepath));
-	if (fp) {
-		fclose(fp);
-		cairo_surface_write_to_png(surface, filepath);
+	surface = cairo_image_surface_create(format->cairo_format,
+					     width, height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return;
 	}
 
-	cairo_surface_destroy(surface);
-	free(data);
+	screenshot_stitch(surface, format, data, width, height, 0, 0);
+	screenshot_write_png_surface(surface, filepath);
+}
+
+static void
+screenshot_write_png_per_output(struct screenshooter_output *sh_output,
+				const char *filepath)
+{
+	screenshot_write_png_data(sh_output->sh_data->format, sh_output->data,
+				  sh_output->width, sh_output->height,
+				  filepath);
 }
 
 static void
@@ -438,6 +562,85 @@ screenshot_set_buffer_size(struct buffer_size *buff_size, struct wl_list *output
 	return 0;
 }
 
+static void *
+screenshot_pool_worker(void *data)
+{
+	struct screenshot_pool *pool = data;
+	struct screenshot_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (wl_list_empty(&pool->jobs) && !pool->finishing)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+
+		if (wl_list_empty(&pool->jobs))
+			break;
+
+		job = container_of(pool->jobs.next, struct screenshot_job, link);
+		wl_list_remove(&job->link);
+
+		pthread_mutex_unlock(&pool->lock);
+		job->run(job);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void
+screenshot_pool_init(struct screenshot_pool *pool, int n_threads)
+{
+	int i;
+
+	wl_list_init(&pool->jobs);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->finishing = false;
+
+	pool->threads = xzalloc(n_threads * sizeof(*pool->threads));
+	for (pool->n_threads = 0; pool->n_threads < n_threads; pool->n_threads++) {
+		i = pool->n_threads;
+		if (pthread_create(&pool->threads[i], NULL,
+				   screenshot_pool_worker, pool) != 0)
+			break;
+	}
+}
+
+/* Without any worker, jobs just run on the calling thread. */
+static void
+screenshot_pool_submit(struct screenshot_pool *pool, struct screenshot_job *job)
+{
+	if (pool->n_threads == 0) {
+		job->run(job);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	wl_list_insert(pool->jobs.prev, &job->link);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* Waits for all the submitted jobs to be done, and stops the workers. */
+static void
+screenshot_pool_finish(struct screenshot_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->finishing = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	free(pool->threads);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+}
+
 static struct screenshooter_output *
 agl_shooter_search_for_output(const char *output_name,
 			      struct screenshooter_data *sh_data)
@@ -468,15 +671,89 @@ agl_shooter_display_all_outputs(struct screenshooter_data *sh_data)
 	}
 }
 
+static void
+screenshot_output_job_run(struct screenshot_job *job)
+{
+	struct screenshooter_output *output =
+		container_of(job, struct screenshooter_output, job);
+	struct screenshot_capture *capture = output->capture;
+
+	if (capture->surface) {
+		/* outputs don't overlap, each has its own part of the image */
+		screenshot_stitch(capture->surface, output->sh_data->format,
+				  output->data, output->width, output->height,
+				  output->offset_x - capture->buff_size.min_x,
+				  output->offset_y - capture->buff_size.min_y);
+		return;
+	}
+
+	screenshot_write_png_per_output(output, output->filepath);
+}
 
 static void
-agl_shooter_screenshot_all_outputs(struct screenshooter_data *sh_data)
+screenshot_output_done(void *data, struct agl_screenshooter *screenshooter,
+		       uint32_t status)
 {
-	struct screenshooter_output *output;
-	struct buffer_size buff_size = {};
+	struct screenshooter_output *output = data;
+	struct screenshot_capture *capture = output->capture;
+
+	capture->pending--;
 
-	if (screenshot_set_buffer_size(&buff_size, &sh_data->output_list))
+	if (status != AGL_SCREENSHOOTER_DONE_STATUS_SUCCESS) {
+		fprintf(stderr, "Failed to take a screenshot of an output "
+				"(status %u)\n", status);
+		capture->failed = true;
 		return;
+	}
+
+	/* file names are picked here as that isn't thread-safe */
+	if (!capture->surface &&
+	    screenshot_create_file(output->filepath, sizeof(output->filepath)) < 0) {
+		capture->failed = true;
+		return;
+	}
+
+	screenshot_pool_submit(&capture->pool, &output->job);
+}
+
+static const struct agl_screenshooter_listener screenshot_output_listener = {
+	screenshot_output_done
+};
+
+/* Takes a screenshot of all the outputs at once, either combined into a
+ * single image or in one image per output. Each output gets its own
+ * agl_screenshooter object to tell the 'done' events apart, so that all
+ * the shots can be requested up front, and each output is stitched or
+ * encoded on the worker pool as soon as it's done. This makes it take
+ * about as long as the slowest output, rather than the sum of them all. */
+static int
+agl_shooter_screenshot_all_outputs(struct screenshooter_data *sh_data,
+				   bool separate)
+{
+	struct screenshooter_output *output;
+	struct screenshot_capture capture = {};
+	char filepath[PATH_MAX];
+	long n_cpus;
+	int n_outputs;
+
+	if (screenshot_set_buffer_size(&capture.buff_size, &sh_data->output_list))
+		return -1;
+
+	if (!separate) {
+		capture.surface =
+			cairo_image_surface_create(sh_data->format->cairo_format,
+						   capture.buff_size.width,
+						   capture.buff_size.height);
+		if (cairo_surface_status(capture.surface) != CAIRO_STATUS_SUCCESS) {
+			cairo_surface_destroy(capture.surface);
+			return -1;
+		}
+		cairo_surface_flush(capture.surface);
+	}
+
+	n_outputs = wl_list_length(&sh_data->output_list);
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	screenshot_pool_init(&capture.pool, MIN(n_outputs, MAX(n_cpus, 1)));
 
 	wl_list_for_each(output, &sh_data->output_list, link) {
 		output->buffer =
@@ -484,28 +761,61 @@ agl_shooter_screenshot_all_outputs(struct screenshooter_data *sh_data)
 						     output->height,
 						     &output->data,
 						     sh_data->shm);
+		if (!output->buffer) {
+			capture.failed = true;
+			continue;
+		}
 
-		agl_screenshooter_take_shot(sh_data->screenshooter,
+		output->capture = &capture;
+		output->job.run = screenshot_output_job_run;
+		output->screenshooter =
+			wl_registry_bind(sh_data->registry,
+					 sh_data->screenshooter_name,
+					 &agl_screenshooter_interface,
+					 sh_data->screenshooter_version);
+		agl_screenshooter_add_listener(output->screenshooter,
+					       &screenshot_output_listener,
+					       output);
+
+		agl_screenshooter_take_shot(output->screenshooter,
 					    output->output,
 					    output->buffer);
+		capture.pending++;
+	}
+
+	while (capture.pending > 0)
+		if (wl_display_dispatch(sh_data->display) < 0)
+			break;
+
+	screenshot_pool_finish(&capture.pool);
+
+	if (capture.surface) {
+		if (!capture.failed &&
+		    screenshot_create_file(filepath, sizeof(filepath)) == 0)
+			screenshot_write_png_surface(capture.surface, filepath);
+		else
+			cairo_surface_destroy(capture.surface);
+	}
 
-		sh_data->buffer_copy_done = 0;
-		while (!sh_data->buffer_copy_done)
-			wl_display_roundtrip(sh_data->display);
+	wl_list_for_each(output, &sh_data->output_list, link) {
+		if (!output->buffer)
+			continue;
+
+		agl_screenshooter_destroy(output->screenshooter);
+		wl_buffer_destroy(output->buffer);
+		munmap(output->data, output->width * 4 * output->height);
+		output->buffer = NULL;
+		output->data = NULL;
 	}
 
-	screenshot_write_png(&buff_size, &sh_data->output_list);
+	return capture.failed || capture.pending > 0 ? -1 : 0;
 }
 
 static void
 agl_shooter_screenshot_output(struct screenshooter_output *sh_output)
 {
-	int pos = 0;
-	struct buffer_size buff_size = {};
 	struct screenshooter_data *sh_data = sh_output->sh_data;
-
-	screenshot_compute_output_offset(&pos, sh_output);
-	screenshot_set_buffer_size_per_output(&buff_size, sh_output);
+	char filepath[PATH_MAX];
 
 	sh_output->buffer =
 		screenshot_create_shm_buffer(sh_output->width,
@@ -520,7 +830,333 @@ agl_shooter_screenshot_output(struct screenshooter_output *sh_output)
 	while (!sh_data->buffer_copy_done)
 		wl_display_roundtrip(sh_data->display);
 
-	screenshot_write_png_per_output(&buff_size, sh_output);
+	if (screenshot_create_file(filepath, sizeof(filepath)) == 0)
+		screenshot_write_png_per_output(sh_output, filepath);
+}
+
+/* Only the rectangle is read back by the compositor, into a buffer of its
+ * size, so there's nothing to crop or stitch on this side either. */
+static int
+agl_shooter_screenshot_region(struct screenshooter_output *sh_output,
+			      const struct screenshooter_region *region)
+{
+	struct screenshooter_data *sh_data = sh_output->sh_data;
+	struct wl_buffer *buffer;
+	char filepath[PATH_MAX];
+	void *data;
+	int ret = 0;
+
+	if (sh_data->screenshooter_version <
+	    AGL_SCREENSHOOTER_TAKE_SHOT_REGION_SINCE_VERSION) {
+		fprintf(stderr, "Compositor doesn't support region screenshots\n");
+		return -1;
+	}
+
+	buffer = screenshot_create_shm_buffer(region->width, region->height,
+					      &data, sh_data->shm);
+	if (!buffer)
+		return -1;
+
+	agl_screenshooter_take_shot_region(sh_data->screenshooter,
+					   sh_output->output, buffer,
+					   region->x, region->y,
+					   region->width, region->height);
+
+	sh_data->buffer_copy_done = 0;
+	while (!sh_data->buffer_copy_done)
+		wl_display_roundtrip(sh_data->display);
+
+	switch (sh_data->status) {
+	case AGL_SCREENSHOOTER_DONE_STATUS_SUCCESS:
+		if (screenshot_create_file(filepath, sizeof(filepath)) == 0)
+			screenshot_write_png_data(sh_data->format, data,
+						  region->width, region->height,
+						  filepath);
+		break;
+	case AGL_SCREENSHOOTER_DONE_STATUS_BAD_REGION:
+		fprintf(stderr, "Region %dx%d+%d+%d doesn't fit in the output\n",
+			region->width, region->height, region->x, region->y);
+		ret = -1;
+		break;
+	default:
+		fprintf(stderr, "Failed to take the screenshot (status %u)\n",
+			sh_data->status);
+		ret = -1;
+		break;
+	}
+
+	wl_buffer_destroy(buffer);
+	munmap(data, region->width * 4 * region->height);
+
+	return ret;
+}
+
+static void
+ring_frame_job_run(struct screenshot_job *job)
+{
+	struct screenshooter_ring_frame *frame =
+		container_of(job, struct screenshooter_ring_frame, job);
+	struct screenshooter_ring_capture *capture = frame->capture;
+	struct screenshooter_output *output = capture->output;
+
+	screenshot_write_png_data(output->sh_data->format,
+				  capture->data[frame->slot],
+				  output->width, output->height,
+				  frame->filepath);
+
+	/* requests can be sent from any thread, but the main one might be
+	 * sitting in poll() by now, so flush it out ourselves */
+	agl_screenshooter_ring_release(capture->ring, frame->slot);
+	wl_display_flush(output->sh_data->display);
+}
+
+static void
+ring_handle_ready(void *data, struct agl_screenshooter_ring *ring,
+		  uint32_t slot, uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+		  uint32_t tv_nsec, uint32_t dropped)
+{
+	struct screenshooter_ring_capture *capture = data;
+	struct screenshooter_ring_frame *frame;
+
+	capture->dropped += dropped;
+	if (capture->frames_left == 0 || slot >= RING_BUFFERS)
+		return;
+
+	capture->frames_left--;
+
+	/* file names are picked here as that isn't thread-safe */
+	frame = &capture->frames[slot];
+	if (screenshot_create_file(frame->filepath,
+				   sizeof(frame->filepath)) < 0) {
+		agl_screenshooter_ring_release(ring, slot);
+		return;
+	}
+
+	/* the slot stays busy until the frame is written out, so the
+	 * compositor carries on capturing into the other ones meanwhile */
+	screenshot_pool_submit(&capture->pool, &frame->job);
+}
+
+static void
+ring_handle_stopped(void *data, struct agl_screenshooter_ring *ring)
+{
+	struct screenshooter_ring_capture *capture = data;
+
+	capture->stopped = true;
+}
+
+static const struct agl_screenshooter_ring_listener ring_listener = {
+	ring_handle_ready,
+	ring_handle_stopped,
+};
+
+/* Captures consecutive frames of an output: the buffers are created and
+ * handed to the compositor once, and then cycled through for as long as
+ * needed, rather than paying for a buffer and a roundtrip per frame. The
+ * frames are encoded on the worker pool, so that reading the events
+ * doesn't wait on them. */
+static int
+agl_shooter_screenshot_ring(struct screenshooter_output *sh_output, int frames)
+{
+	struct screenshooter_data *sh_data = sh_output->sh_data;
+	struct screenshooter_ring_capture capture = {};
+	size_t size = sh_output->width * 4 * sh_output->height;
+	long n_cpus;
+	int i;
+
+	if (sh_data->screenshooter_version <
+	    AGL_SCREENSHOOTER_CREATE_RING_SINCE_VERSION) {
+		fprintf(stderr, "Compositor doesn't support capturing frames "
+				"continuously\n");
+		return -1;
+	}
+
+	capture.output = sh_output;
+	capture.frames_left = frames;
+
+	capture.ring = agl_screenshooter_create_ring(sh_data->screenshooter,
+						     sh_output->output);
+	agl_screenshooter_ring_add_listener(capture.ring, &ring_listener,
+					    &capture);
+
+	for (i = 0; i < RING_BUFFERS; i++) {
+		capture.buffers[i] =
+			screenshot_create_shm_buffer(sh_output->width,
+						     sh_output->height,
+						     &capture.data[i],
+						     sh_data->shm);
+		if (!capture.buffers[i])
+			goto out;
+
+		agl_screenshooter_ring_add_buffer(capture.ring,
+						  capture.buffers[i]);
+	}
+
+	for (i = 0; i < RING_BUFFERS; i++) {
+		capture.frames[i].capture = &capture;
+		capture.frames[i].slot = i;
+		capture.frames[i].job.run = ring_frame_job_run;
+	}
+
+	/* one worker per buffer at most, any more would have nothing to do */
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	screenshot_pool_init(&capture.pool, MIN(RING_BUFFERS, MAX(n_cpus, 1)));
+
+	agl_screenshooter_ring_start(capture.ring);
+
+	while (capture.frames_left > 0 && !capture.stopped)
+		if (wl_display_dispatch(sh_data->display) < 0)
+			break;
+
+	screenshot_pool_finish(&capture.pool);
+
+	if (capture.stopped && capture.frames_left > 0)
+		fprintf(stderr, "Output went away, %d frame(s) not captured\n",
+			capture.frames_left);
+
+	if (capture.dropped)
+		fprintf(stderr, "%u frame(s) dropped while capturing\n",
+			capture.dropped);
+
+out:
+	agl_screenshooter_ring_destroy(capture.ring);
+	for (i = 0; i < RING_BUFFERS && capture.buffers[i]; i++) {
+		wl_buffer_destroy(capture.buffers[i]);
+		munmap(capture.data[i], size);
+	}
+
+	return capture.frames_left > 0 ? -1 : 0;
+}
+
+static void
+stream_handle_damage(void *data, struct agl_screenshooter_stream *stream,
+		     int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct screenshooter_stream_capture *capture = data;
+	struct stream_rect *rect;
+
+	if (capture->n_rects == capture->max_rects) {
+		capture->max_rects = MAX(capture->max_rects * 2, 16);
+		capture->rects = xrealloc(capture->rects, capture->max_rects *
+					  sizeof(*capture->rects));
+	}
+
+	rect = &capture->rects[capture->n_rects++];
+	rect->x = x;
+	rect->y = y;
+	rect->width = width;
+	rect->height = height;
+}
+
+static int
+stream_write_frame(struct screenshooter_stream_capture *capture,
+		   uint64_t tv_sec, uint32_t tv_nsec)
+{
+	struct screenshooter_output *output = capture->output;
+	struct stream_frame_header header = {
+		.magic = STREAM_MAGIC,
+		.width = output->width,
+		.height = output->height,
+		.n_rects = capture->n_rects,
+		.tv_sec = tv_sec,
+		.tv_nsec = tv_nsec,
+	};
+	int stride = output->width * 4;
+	uint32_t i;
+	int j;
+
+	if (fwrite(&header, sizeof(header), 1, capture->fp) != 1)
+		return -1;
+
+	if (capture->n_rects &&
+	    fwrite(capture->rects, sizeof(*capture->rects),
+		   capture->n_rects, capture->fp) != capture->n_rects)
+		return -1;
+
+	for (i = 0; i < capture->n_rects; i++) {
+		struct stream_rect *rect = &capture->rects[i];
+		uint8_t *s = (uint8_t *) capture->data +
+			     rect->y * stride + rect->x * 4;
+
+		for (j = 0; j < rect->height; j++, s += stride)
+			if (fwrite(s, rect->width * 4, 1, capture->fp) != 1)
+				return -1;
+	}
+
+	return fflush(capture->fp);
+}
+
+static void
+stream_handle_frame(void *data, struct agl_screenshooter_stream *stream,
+		    uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec)
+{
+	struct screenshooter_stream_capture *capture = data;
+	uint64_t tv_sec = ((uint64_t) tv_sec_hi << 32) | tv_sec_lo;
+
+	if (stream_write_frame(capture, tv_sec, tv_nsec) < 0) {
+		/* most likely the reading end went away */
+		capture->done = 1;
+		return;
+	}
+
+	capture->n_rects = 0;
+	agl_screenshooter_stream_release(stream);
+}
+
+static const struct agl_screenshooter_stream_listener stream_listener = {
+	stream_handle_damage,
+	stream_handle_frame,
+};
+
+/* Records an output to stdout for as long as it's being read from. Only
+ * what changed between two frames is copied by the compositor and written
+ * out here, so a mostly static display costs next to nothing. */
+static int
+agl_shooter_screenshot_stream(struct screenshooter_output *sh_output)
+{
+	struct screenshooter_data *sh_data = sh_output->sh_data;
+	struct screenshooter_stream_capture capture = {};
+
+	if (sh_data->screenshooter_version <
+	    AGL_SCREENSHOOTER_CREATE_STREAM_SINCE_VERSION) {
+		fprintf(stderr, "Compositor doesn't support streaming\n");
+		return -1;
+	}
+
+	if (isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "Not streaming raw frames to a terminal, "
+				"redirect stdout to a file or a pipe\n");
+		return -1;
+	}
+
+	/* get EPIPE instead of being killed when the reader goes away */
+	signal(SIGPIPE, SIG_IGN);
+
+	capture.output = sh_output;
+	capture.fp = stdout;
+	capture.buffer = screenshot_create_shm_buffer(sh_output->width,
+						      sh_output->height,
+						      &capture.data,
+						      sh_data->shm);
+	if (!capture.buffer)
+		return -1;
+
+	capture.stream = agl_screenshooter_create_stream(sh_data->screenshooter,
+							 sh_output->output,
+							 capture.buffer);
+	agl_screenshooter_stream_add_listener(capture.stream, &stream_listener,
+					      &capture);
+
+	while (!capture.done)
+		if (wl_display_dispatch(sh_data->display) < 0)
+			break;
+
+	agl_screenshooter_stream_destroy(capture.stream);
+	wl_buffer_destroy(capture.buffer);
+	munmap(capture.data, sh_output->width * 4 * sh_output->height);
+	free(capture.rects);
+
+	return 0;
 }
 
 static void
@@ -540,12 +1176,23 @@ agl_shooter_destroy_xdg_output_manager(struct screenshooter_data *sh_data)
 static void
 print_usage_and_exit(void)
 {
-	fprintf(stderr, "./agl-screenshooter [-o OUTPUT_NAME] [-l] [-a]\n");
+	fprintf(stderr, "./agl-screenshooter [-o OUTPUT_NAME] [-l] [-a] [-e] "
+			"[-r FRAMES] [-g WxH+X+Y] [-s] [-f FORMAT]\n");
 
 	fprintf(stderr, "\t-o OUTPUT_NAME -- take a screenshot of the output "
 				"specified by OUTPUT_NAME\n");
 	fprintf(stderr, "\t-a  -- take a screenshot of all the outputs found\n");
+	fprintf(stderr, "\t-e  -- take a screenshot of each of the outputs "
+				"found, in a file per output\n");
 	fprintf(stderr, "\t-l  -- list all the outputs found\n");
+	fprintf(stderr, "\t-r FRAMES -- take a screenshot of each of the next "
+				"FRAMES frames of the output\n");
+	fprintf(stderr, "\t-g WxH+X+Y -- take a screenshot of only that "
+				"region of the output\n");
+	fprintf(stderr, "\t-s  -- stream the changes of the output to stdout, "
+				"as raw frames and damage rectangles\n");
+	fprintf(stderr, "\t-f FORMAT -- write images as argb32 (default), "
+				"rgb24 or rgb565\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -557,18 +1204,28 @@ int main(int argc, char *argv[])
 	struct screenshooter_data sh_data = {};
 	struct screenshooter_output *sh_output = NULL;
 	int c, option_index;
+	int ret = EXIT_SUCCESS;
 
 	char *output_name = NULL;
+	int frames = 0;
+
+	sh_data.format = &screenshot_formats[0];
+	struct screenshooter_region region = {};
 
 	static struct option long_options[] = {
 		{"output", 	required_argument, 0,  'o' },
 		{"list", 	required_argument, 0,  'l' },
 		{"all", 	required_argument, 0,  'a' },
+		{"each",	no_argument      , 0,  'e' },
+		{"ring",	required_argument, 0,  'r' },
+		{"region",	required_argument, 0,  'g' },
+		{"stream",	no_argument      , 0,  's' },
+		{"format",	required_argument, 0,  'f' },
 		{"help",	no_argument      , 0,  'h' },
 		{0, 0, 0, 0}
 	};
 
-	while ((c = getopt_long(argc, argv, "o:lah",
+	while ((c = getopt_long(argc, argv, "o:laer:g:sf:h",
 				long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'o':
@@ -581,6 +1238,32 @@ int main(int argc, char *argv[])
 		case 'a':
 			opts |= (1 << OPT_SCREENSHOT_ALL_OUTPUTS);
 			break;
+		case 'e':
+			opts |= (1 << OPT_SCREENSHOT_EACH_OUTPUT);
+			break;
+		case 'r':
+			frames = atoi(optarg);
+			if (frames <= 0)
+				print_usage_and_exit();
+			opts |= (1 << OPT_SCREENSHOT_RING);
+			break;
+		case 'g':
+			if (sscanf(optarg, "%dx%d+%d+%d",
+				   &region.width, &region.height,
+				   &region.x, &region.y) != 4 ||
+			    region.width <= 0 || region.height <= 0 ||
+			    region.x < 0 || region.y < 0)
+				print_usage_and_exit();
+			opts |= (1 << OPT_SCREENSHOT_REGION);
+			break;
+		case 's':
+			opts |= (1 << OPT_SCREENSHOT_STREAM);
+			break;
+		case 'f':
+			sh_data.format = screenshot_format_from_name(optarg);
+			if (!sh_data.format)
+				print_usage_and_exit();
+			break;
 		default:
 			print_usage_and_exit();
 		}
@@ -598,6 +1281,7 @@ int main(int argc, char *argv[])
 	sh_data.display = display;
 
 	registry = wl_display_get_registry(display);
+	sh_data.registry = registry;
 	wl_registry_add_listener(registry, &registry_listener, &sh_data);
 
 	wl_display_dispatch(display);
@@ -621,10 +1305,13 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
-	if (opts & (1 << OPT_SCREENSHOT_ALL_OUTPUTS)) {
-		agl_shooter_screenshot_all_outputs(&sh_data);
+	if (opts & ((1 << OPT_SCREENSHOT_ALL_OUTPUTS) |
+		    (1 << OPT_SCREENSHOT_EACH_OUTPUT))) {
+		if (agl_shooter_screenshot_all_outputs(&sh_data,
+				opts & (1 << OPT_SCREENSHOT_EACH_OUTPUT)) < 0)
+			ret = EXIT_FAILURE;
 		agl_shooter_destroy_xdg_output_manager(&sh_data);
-		return EXIT_SUCCESS;
+		return ret;
 	}
 
 	sh_output = NULL;
@@ -645,9 +1332,30 @@ int main(int argc, char *argv[])
 		sh_output = container_of(sh_data.output_list.next,
 					 struct screenshooter_output, link);
 
+	if (opts & (1 << OPT_SCREENSHOT_STREAM)) {
+		if (agl_shooter_screenshot_stream(sh_output) < 0)
+			ret = EXIT_FAILURE;
+		agl_shooter_destroy_xdg_output_manager(&sh_data);
+		return ret;
+	}
+
+	if (opts & (1 << OPT_SCREENSHOT_REGION)) {
+		if (agl_shooter_screenshot_region(sh_output, &region) < 0)
+			ret = EXIT_FAILURE;
+		agl_shooter_destroy_xdg_output_manager(&sh_data);
+		return ret;
+	}
+
+	if (opts & (1 << OPT_SCREENSHOT_RING)) {
+		if (agl_shooter_screenshot_ring(sh_output, frames) < 0)
+			ret = EXIT_FAILURE;
+		agl_shooter_destroy_xdg_output_manager(&sh_data);
+		return ret;
+	}
+
 	/* take a screenshot only of that specific output */
 	agl_shooter_screenshot_output(sh_output);
 	agl_shooter_destroy_xdg_output_manager(&sh_data);
 
-	return 0;
+	return ret;
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "screenshot-convert.h"
+
+void
+screenshot_convert_row_argb32(void *dst, const uint32_t *src, int n)
+{
+	memcpy(dst, src, n * 4);
+}
+
+void
+screenshot_convert_row_rgb24(void *dst, const uint32_t *src, int n)
+{
+	uint32_t *d = dst;
+	int i = 0;
+
+	/* the X byte is undefined, cairo wants it to be opaque */
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (d + i), _mm_or_si128(p, alpha));
+	}
+#elif defined(__ARM_NEON)
+	const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+
+	for (; i + 4 <= n; i += 4)
+		vst1q_u32(d + i, vorrq_u32(vld1q_u32(src + i), alpha));
+#endif
+	for (; i < n; i++)
+		d[i] = src[i] | 0xff000000;
+}
+
+void
+screenshot_convert_row_rgb565(void *dst, const uint32_t *src, int n)
+{
+	uint16_t *d = dst;
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i mask_r = _mm_set1_epi32(0xf800);
+	const __m128i mask_g = _mm_set1_epi32(0x07e0);
+	const __m128i mask_b = _mm_set1_epi32(0x001f);
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i *) (src + i + 4));
+		__m128i q0, q1;
+
+		q0 = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_srli_epi32(p0, 8), mask_r),
+			_mm_and_si128(_mm_srli_epi32(p0, 5), mask_g)),
+			_mm_and_si128(_mm_srli_epi32(p0, 3), mask_b));
+		q1 = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_srli_epi32(p1, 8), mask_r),
+			_mm_and_si128(_mm_srli_epi32(p1, 5), mask_g)),
+			_mm_and_si128(_mm_srli_epi32(p1, 3), mask_b));
+
+		/* sign-extend, so that the saturating pack keeps the bits */
+		q0 = _mm_srai_epi32(_mm_slli_epi32(q0, 16), 16);
+		q1 = _mm_srai_epi32(_mm_slli_epi32(q1, 16), 16);
+		_mm_storeu_si128((__m128i *) (d + i), _mm_packs_epi32(q0, q1));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= n; i += 8) {
+		/* little-endian XRGB8888 is B, G, R, X in memory */
+		uint8x8x4_t p = vld4_u8((const uint8_t *) (src + i));
+		uint16x8_t q;
+
+		q = vshll_n_u8(p.val[2], 8);
+		q = vsriq_n_u16(q, vshll_n_u8(p.val[1], 8), 5);
+		q = vsriq_n_u16(q, vshll_n_u8(p.val[0], 8), 11);
+		vst1q_u16(d + i, q);
+	}
+#endif
+	for (; i < n; i++)
+		d[i] = ((src[i] >> 8) & 0xf800) |
+		       ((src[i] >> 5) & 0x07e0) |
+		       ((src[i] >> 3) & 0x001f);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SCREENSHOT_CONVERT_H
+#define SCREENSHOT_CONVERT_H
+
+#include <stdint.h>
+
+/*
+ * Row converters from the XRGB8888 shm buffers filled in by the compositor
+ * to the format of the final image, with SSE2 or NEON variants where
+ * available; 'n' is the number of pixels.
+ */
+
+/* a plain copy */
+void
+screenshot_convert_row_argb32(void *dst, const uint32_t *src, int n);
+
+/* sets the X byte, which is undefined, to opaque */
+void
+screenshot_convert_row_rgb24(void *dst, const uint32_t *src, int n);
+
+void
+screenshot_convert_row_rgb565(void *dst, const uint32_t *src, int n);
+
+#endif
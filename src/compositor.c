@@ -96,6 +96,10 @@ handle_output_destroy(struct wl_listener *listener, void *data)
 		output->fullscreen_view.fs->view = NULL;
 	}
 
+	/* properties set for this output can't be applied anymore */
+	ivi_remove_pending_desktop_surfaces(output);
+	wl_list_remove(&output->frame_listener.link);
+
 	output->output = NULL;
 	wl_list_remove(&output->output_destroy.link);
 }
@@ -127,6 +131,7 @@ ivi_output_configure_app_id(struct ivi_output *ivi_output)
 		if (ivi_output->app_id == NULL)
 			return;
 
+		ivi_output->app_id_hash = ivi_app_id_hash(ivi_output->app_id);
 		weston_log("Will place app_id %s on output %s\n",
 				ivi_output->app_id, ivi_output->name);
 	}
@@ -161,7 +166,10 @@ ivi_ensure_output(struct ivi_compositor *ivi, char *name,
 		return NULL;
 	}
 
+	wl_list_init(&output->split_panes);
+	wl_list_init(&output->mru);
 	output->output_destroy.notify = handle_output_destroy;
+	ivi_layout_throttle_output_init(output);
 	weston_output_add_destroy_listener(output->output,
 					   &output->output_destroy);
 
@@ -777,7 +785,10 @@ ivi_enable_remote_outputs(struct ivi_compositor *ivi)
 			continue;
 		}
 
+		wl_list_init(&ivi_output->split_panes);
+		wl_list_init(&ivi_output->mru);
 		ivi_output->output_destroy.notify = handle_output_destroy;
+		ivi_layout_throttle_output_init(ivi_output);
 		weston_output_add_destroy_listener(ivi_output->output,
 						   &ivi_output->output_destroy);
 
@@ -829,7 +840,10 @@ ivi_enable_waltham_outputs(struct ivi_compositor *ivi)
 		}
 
 		ivi_output->type = OUTPUT_WALTHAM;
+		wl_list_init(&ivi_output->split_panes);
+		wl_list_init(&ivi_output->mru);
 		ivi_output->output_destroy.notify = handle_output_destroy;
+		ivi_layout_throttle_output_init(ivi_output);
 		weston_output_add_destroy_listener(ivi_output->output,
 				&ivi_output->output_destroy);
 
@@ -1722,6 +1736,7 @@ int wet_main(int argc, char *argv[])
 	char *config_file = NULL;
 	struct weston_log_context *log_ctx = NULL;
 	struct weston_log_subscriber *logger;
+	uint32_t warm_cache_mb;
 	int ret = EXIT_FAILURE;
 	bool xwayland = false;
 
@@ -1741,11 +1756,16 @@ int wet_main(int argc, char *argv[])
 	wl_list_init(&ivi.outputs);
 	wl_list_init(&ivi.surfaces);
 	wl_list_init(&ivi.pending_surfaces);
-	wl_list_init(&ivi.popup_pending_apps);
-	wl_list_init(&ivi.fullscreen_pending_apps);
-	wl_list_init(&ivi.split_pending_apps);
-	wl_list_init(&ivi.remote_pending_apps);
 	wl_list_init(&ivi.desktop_clients);
+	wl_list_init(&ivi.layout_txn.staged);
+	wl_list_init(&ivi.layout_txn.in_flight);
+	wl_list_init(&ivi.warm_cache.surfaces);
+	wl_list_init(&ivi.throttle.surfaces);
+
+	for (size_t i = 0; i < ARRAY_LENGTH(ivi.app_ids); i++)
+		wl_list_init(&ivi.app_ids[i]);
+	for (size_t i = 0; i < ARRAY_LENGTH(ivi.pending_apps); i++)
+		wl_list_init(&ivi.pending_apps[i]);
 
 	/* Prevent any clients we spawn getting our stdin */
 	os_fd_set_cloexec(STDIN_FILENO);
@@ -1770,6 +1790,21 @@ int wet_main(int argc, char *argv[])
         log_scope = weston_compositor_add_log_scope(log_ctx, "log",
 						    "agl-compositor log\n",
 						    NULL, NULL, NULL);
+	ivi.warm_cache.scope =
+		weston_compositor_add_log_scope(log_ctx, "warm-cache",
+						"warm surface cache hits, misses and "
+						"activation latency\n",
+						NULL, NULL, NULL);
+	ivi.switch_damage_scope =
+		weston_compositor_add_log_scope(log_ctx, "switch-damage",
+						"damage of the switches between "
+						"active surfaces\n",
+						NULL, NULL, NULL);
+	ivi.policy_scope =
+		weston_compositor_add_log_scope(log_ctx, "policy",
+						"state changes and timeouts of "
+						"the policy rules\n",
+						NULL, NULL, NULL);
 
 	log_file_open(log);
 	weston_log_set_handler(vlog, vlog_continue);
@@ -1794,6 +1829,17 @@ int wet_main(int argc, char *argv[])
 	/* from [core] */
 	weston_config_section_get_bool(section, "hide-cursor", &ivi.hide_cursor, false);
 	weston_config_section_get_bool(section, "activate-by-default", &ivi.activate_by_default, true);
+	weston_config_section_get_int(section, "warm-cache-size",
+				      &ivi.warm_cache.max_count, 0);
+	weston_config_section_get_uint(section, "warm-cache-memory",
+				       &warm_cache_mb, 64);
+	ivi.warm_cache.max_bytes = (uint64_t) warm_cache_mb * 1024 * 1024;
+	weston_config_section_get_int(section, "occluded-frame-rate",
+				      &ivi.throttle.rate, 1);
+	/* the callbacks are released by a timer with a millisecond
+	 * resolution, which a zero interval would disarm */
+	if (ivi.throttle.rate > 1000)
+		ivi.throttle.rate = 1000;
 
 	display = wl_display_create();
 	loop = wl_display_get_event_loop(display);
@@ -1873,6 +1919,7 @@ int wet_main(int argc, char *argv[])
 	weston_compositor_wake(ivi.compositor);
 
 	ivi_shell_create_global(&ivi);
+	ivi_tracer_create(&ivi);
 	ivi_launch_shell_client(&ivi);
 	if (debug)
 		ivi_screenshooter_create(&ivi);
@@ -1889,6 +1936,12 @@ error_compositor:
 
 	weston_compositor_log_scope_destroy(log_scope);
 	log_scope = NULL;
+	weston_compositor_log_scope_destroy(ivi.warm_cache.scope);
+	ivi.warm_cache.scope = NULL;
+	weston_compositor_log_scope_destroy(ivi.switch_damage_scope);
+	ivi.switch_damage_scope = NULL;
+	weston_compositor_log_scope_destroy(ivi.policy_scope);
+	ivi.policy_scope = NULL;
 
 	weston_log_ctx_compositor_destroy(ivi.compositor);
 	weston_compositor_destroy(ivi.compositor);
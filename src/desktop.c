@@ -24,6 +24,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include "ivi-compositor.h"
 #include "policy.h"
 
@@ -138,6 +139,17 @@ desktop_surface_added(struct weston_desktop_surface *dsurface, void *userdata)
 	surface->advertised_on_launch = false;
 	surface->checked_pending = false;
 	wl_list_init(&surface->link);
+	wl_list_init(&surface->app_id_link);
+	wl_list_init(&surface->pending.link);
+	wl_list_init(&surface->warm.link);
+	wl_list_init(&surface->mru.link);
+	wl_list_init(&surface->throttle.callbacks);
+	wl_list_init(&surface->throttle.link);
+
+	app_id = weston_desktop_surface_get_app_id(dsurface);
+	if (app_id)
+		surface->app_id = strdup(app_id);
+	surface->app_id_hash = ivi_app_id_hash(surface->app_id);
 
 	wl_signal_init(&surface->signal_advertise_app);
 
@@ -153,9 +165,6 @@ desktop_surface_added(struct weston_desktop_surface *dsurface, void *userdata)
 		return;
 	}
 
-
-	app_id = weston_desktop_surface_get_app_id(dsurface);
-
 	if ((active_output = ivi_layout_find_with_app_id(app_id, ivi)))
 		ivi_set_pending_desktop_surface_remote(active_output, app_id);
 
@@ -192,17 +201,15 @@ desktop_surface_added(struct weston_desktop_surface *dsurface, void *userdata)
 
 }
 
+/* desktop surfaces move between outputs, so those are only counted
+ * globally */
 static bool
-desktop_surface_check_last_remote_surfaces(struct ivi_compositor *ivi, enum ivi_surface_role role)
+desktop_surface_check_last_remote_surfaces(struct ivi_output *output, enum ivi_surface_role role)
 {
-	int count = 0;
-	struct ivi_surface *surf;
-
-	wl_list_for_each(surf, &ivi->surfaces, link)
-		if (surf->role == role)
-			count++;
+	if (role == IVI_SURFACE_ROLE_DESKTOP)
+		return output->ivi->role_count[role] == 1;
 
-	return (count == 1);
+	return output->role_count[role] == 1;
 }
 
 static void
@@ -219,6 +226,11 @@ desktop_surface_removed(struct weston_desktop_surface *dsurface, void *userdata)
 	wl_list_remove(&surface->listener_advertise_app.link);
 	surface->listener_advertise_app.notify = NULL;
 
+	ivi_layout_transaction_remove_surface(surface);
+	ivi_layout_warm_cache_remove(surface);
+	ivi_layout_mru_remove(surface);
+	ivi_layout_throttle_release(surface);
+
 	app_id = weston_desktop_surface_get_app_id(dsurface);
 
 	/* special corner-case, pending_surfaces which are never activated or
@@ -233,15 +245,10 @@ desktop_surface_removed(struct weston_desktop_surface *dsurface, void *userdata)
 
 	assert(output != NULL);
 
-	/* resize the active surface to the original size */
+	/* give the area back to the other panes and the active surface */
 	if (surface->role == IVI_SURFACE_ROLE_SPLIT_H ||
-	    surface->role == IVI_SURFACE_ROLE_SPLIT_V) {
-		if (output && output->active) {
-			ivi_layout_desktop_resize(output->active, output->area_saved);
-		}
-		/* restore the area back so we can re-use it again if needed */
-		output->area = output->area_saved;
-	}
+	    surface->role == IVI_SURFACE_ROLE_SPLIT_V)
+		ivi_layout_split_removed(surface);
 
 	/* reset the active surface as well */
 	if (output && output->active && output->active == surface) {
@@ -259,9 +266,9 @@ desktop_surface_removed(struct weston_desktop_surface *dsurface, void *userdata)
 	/* check if there's a last 'remote' surface and insert a black
 	 * surface view if there's no background set for that output
 	 */
-	if ((desktop_surface_check_last_remote_surfaces(output->ivi,
+	if ((desktop_surface_check_last_remote_surfaces(output,
 		IVI_SURFACE_ROLE_REMOTE) ||
-	    desktop_surface_check_last_remote_surfaces(output->ivi,
+	    desktop_surface_check_last_remote_surfaces(output,
 		IVI_SURFACE_ROLE_DESKTOP)) && output->type == OUTPUT_REMOTE)
 		if (!output->background)
 			insert_black_surface(output);
@@ -304,7 +311,10 @@ skip_output_asignment:
 					  NULL, AGL_SHELL_DESKTOP_APP_STATE_DESTROYED);
 
 	wl_list_remove(&surface->link);
+	ivi_app_id_index_remove(surface);
+	ivi_surface_role_untrack(surface);
 
+	free(surface->app_id);
 	free(surface);
 }
 
@@ -317,6 +327,10 @@ desktop_committed(struct weston_desktop_surface *dsurface,
 		weston_desktop_surface_get_user_data(dsurface);
 	struct ivi_policy *policy = surface->ivi->policy;
 
+	ivi_app_id_index_update(surface);
+	ivi_tracer_commit(surface);
+	ivi_layout_throttle_committed(surface);
+
 	if (policy && policy->api.surface_commited &&
 	    !policy->api.surface_commited(surface, surface->ivi))
 		return;
@@ -337,6 +351,11 @@ desktop_committed(struct weston_desktop_surface *dsurface,
 
 	weston_compositor_schedule_repaint(surface->ivi->compositor);
 
+	/* surfaces which are part of a layout transaction get placed once
+	 * all of the surfaces in it caught up */
+	if (ivi_layout_transaction_surface_committed(surface))
+		return;
+
 	switch (surface->role) {
 	case IVI_SURFACE_ROLE_DESKTOP:
 	case IVI_SURFACE_ROLE_REMOTE:
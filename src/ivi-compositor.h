@@ -38,6 +38,12 @@
 
 #include "agl-shell-server-protocol.h"
 
+/* number of buckets used by the app_id index, must be a power of two */
+#define IVI_APP_ID_HASH_SIZE	256
+
+/* how many recently activated surfaces an output remembers */
+#define IVI_OUTPUT_MRU_SIZE	8
+
 struct ivi_compositor;
 
 struct desktop_client {
@@ -46,6 +52,19 @@ struct desktop_client {
 	struct wl_list link;	/* ivi_compositor::desktop_clients */
 };
 
+enum ivi_surface_role {
+	IVI_SURFACE_ROLE_NONE,
+	IVI_SURFACE_ROLE_DESKTOP,
+	IVI_SURFACE_ROLE_BACKGROUND,
+	IVI_SURFACE_ROLE_PANEL,
+	IVI_SURFACE_ROLE_POPUP,
+	IVI_SURFACE_ROLE_FULLSCREEN,
+	IVI_SURFACE_ROLE_SPLIT_V,
+	IVI_SURFACE_ROLE_SPLIT_H,
+	IVI_SURFACE_ROLE_REMOTE,
+};
+#define IVI_SURFACE_ROLE_COUNT	(IVI_SURFACE_ROLE_REMOTE + 1)
+
 struct ivi_compositor {
 	struct weston_compositor *compositor;
 	struct weston_config *config;
@@ -86,16 +105,62 @@ struct ivi_compositor {
 
 	struct wl_list outputs; /* ivi_output.link */
 	struct wl_list surfaces; /* ivi_surface.link */
+	/* number of surfaces in 'surfaces', per role */
+	uint32_t role_count[IVI_SURFACE_ROLE_COUNT];
+
+	/* hash index, keyed by app_id, of the surfaces found in 'surfaces' */
+	struct wl_list app_ids[IVI_APP_ID_HASH_SIZE]; /* ivi_surface.app_id_link */
 
 	struct weston_desktop *desktop;
 	struct wl_listener seat_created_listener;
 	struct ivi_policy *policy;
 
 	struct wl_list pending_surfaces;
-	struct wl_list popup_pending_apps;
-	struct wl_list fullscreen_pending_apps;
-	struct wl_list split_pending_apps;
-	struct wl_list remote_pending_apps;
+
+	/* role properties set with agl_shell_desktop.set_app_property, keyed
+	 * by app_id, and consumed when the surface is first committed */
+	struct wl_list pending_apps[IVI_APP_ID_HASH_SIZE]; /* pending_app::link */
+
+	/* layout changes staged with ivi_layout_set_position(),
+	 * ivi_layout_set_mapped() and ivi_layout_set_unmapped(), and the ones
+	 * committed but still waiting
+	 * for clients to catch up with their new size */
+	struct {
+		struct wl_list staged;		/* ivi_surface::pending.link */
+		struct wl_list in_flight;	/* ivi_surface::pending.link */
+		struct wl_event_source *timer;
+	} layout_txn;
+
+	/* recently deactivated desktop surfaces, kept configured at the size
+	 * of their output and parked in the hidden layer such that activating
+	 * them again doesn't need to wait on the client */
+	struct {
+		struct wl_list surfaces;	/* ivi_surface::warm.link, MRU first */
+		int32_t max_count;
+		uint64_t max_bytes;
+		int32_t count;
+		uint64_t bytes;
+		uint32_t hits;
+		uint32_t misses;
+		struct weston_log_scope *scope;
+	} warm_cache;
+
+	struct ivi_tracer *tracer;
+
+	/* damage of the switches between active surfaces */
+	struct weston_log_scope *switch_damage_scope;
+
+	/* state changes and timeouts of the policy rules */
+	struct weston_log_scope *policy_scope;
+
+	/* frame callbacks held back for surfaces nobody can see */
+	struct {
+		/* frames per second, 0 stops them entirely while occluded and
+		 * a negative value disables throttling */
+		int32_t rate;
+		struct wl_list surfaces;	/* ivi_surface::throttle.link */
+		struct wl_event_source *timer;
+	} throttle;
 
 	struct weston_layer hidden;
 	struct weston_layer background;
@@ -137,68 +202,72 @@ struct ivi_output {
 	} fullscreen_view;
 
 	struct wl_listener output_destroy;
+	/* re-evaluates which surfaces are occluded after each repaint */
+	struct wl_listener frame_listener;
 
 	/*
 	 * Usable area for normal clients, i.e. with panels removed.
 	 * In output-coorrdinate space.
 	 */
 	struct weston_geometry area;
-	struct weston_geometry area_saved;
+
+	/*
+	 * Split surfaces are tiled in the order they were added: each one
+	 * takes its share of what the previous ones left over, out of
+	 * area_full, and whatever remains is 'area'.
+	 */
+	struct weston_geometry area_full;
+	struct wl_list split_panes;	/* ivi_split_surface::link */
 
 	struct ivi_surface *active;
-	struct ivi_surface *previous_active;
+
+	/* surfaces recently activated on this output, most recent (the
+	 * active one) first, and at most IVI_OUTPUT_MRU_SIZE of them */
+	struct wl_list mru;	/* ivi_surface::mru.link */
+	int mru_len;
+
+	/* number of surfaces bound to this output, per role; desktop surfaces
+	 * move between outputs, so those are only counted globally */
+	uint32_t role_count[IVI_SURFACE_ROLE_COUNT];
+
+	/* pixels not repainted when switching the active surface, compared
+	 * to damaging both the old and the new view entirely, reported in
+	 * the 'switch-damage' log scope */
+	uint64_t switch_damage_saved;
 
 	/* Temporary: only used during configuration */
 	size_t add_len;
 	struct weston_head *add[8];
 
 	char *app_id;
+	uint32_t app_id_hash;
 	enum ivi_output_type type;
 };
 
-enum ivi_surface_role {
-	IVI_SURFACE_ROLE_NONE,
-	IVI_SURFACE_ROLE_DESKTOP,
-	IVI_SURFACE_ROLE_BACKGROUND,
-	IVI_SURFACE_ROLE_PANEL,
-	IVI_SURFACE_ROLE_POPUP,
-	IVI_SURFACE_ROLE_FULLSCREEN,
-	IVI_SURFACE_ROLE_SPLIT_V,
-	IVI_SURFACE_ROLE_SPLIT_H,
-	IVI_SURFACE_ROLE_REMOTE,
-};
-
 struct ivi_bounding_box {
 	int x; int y;
 	int width; int height;
 };
 
-struct pending_popup {
+struct pending_app {
 	struct ivi_output *ioutput;
 	char *app_id;
-	int x; int y;
-	struct ivi_bounding_box bb;
-
-	struct wl_list link;	/** ivi_compositor::popup_pending_surfaces */
-};
+	uint32_t app_id_hash;
 
-struct pending_fullscreen {
-	struct ivi_output *ioutput;
-	char *app_id;
-	struct wl_list link;	/** ivi_compositor::fullscreen_pending_apps */
-};
+	/* one of popup, fullscreen, split_v/split_h or remote */
+	enum ivi_surface_role role;
+	union {
+		struct {
+			int x; int y;
+			struct ivi_bounding_box bb;
+		} popup;
+		struct {
+			uint32_t orientation;
+			uint32_t ratio;
+		} split;
+	};
 
-struct pending_split {
-	struct ivi_output *ioutput;
-	char *app_id;
-	uint32_t orientation;
-	struct wl_list link;	/** ivi_compositor::split_pending_apps */
-};
-
-struct pending_remote {
-	struct ivi_output *ioutput;
-	char *app_id;
-	struct wl_list link;    /** ivi_compositor::remote_pending_apps */
+	struct wl_list link;	/** ivi_compositor::pending_apps */
 };
 
 struct ivi_desktop_surface {
@@ -223,6 +292,11 @@ struct ivi_fullscreen_surface {
 struct ivi_split_surface {
 	struct ivi_output *output;
 	uint32_t orientation;
+	/* percentage of the remaining area taken by this pane */
+	uint32_t ratio;
+	/* last geometry computed for this pane, in global coordinates */
+	struct weston_geometry geom;
+	struct wl_list link;	/* ivi_output::split_panes */
 };
 
 struct ivi_remote_surface {
@@ -238,6 +312,7 @@ enum ivi_surface_flags {
 	IVI_SURFACE_PROP_MAP = (1 << 0),
 	/* x, y, width, height */
 	IVI_SURFACE_PROP_POSITION = (1 << 1),
+	IVI_SURFACE_PROP_UNMAP = (1 << 2),
 };
 
 /* the waltham surface is a pointer type as well and
@@ -256,11 +331,58 @@ struct ivi_surface {
 	struct wl_list link;
 	int focus_count;
 
+	/* copy of the xdg app_id, refreshed on commit, used as key for
+	 * ivi_compositor::app_ids */
+	char *app_id;
+	uint32_t app_id_hash;
+	struct wl_list app_id_link;	/* ivi_compositor::app_ids */
+
+	/* what this surface is accounted for in the role counters, while
+	 * it is part of ivi_compositor::surfaces */
+	struct {
+		bool tracked;
+		enum ivi_surface_role role;
+		struct ivi_output *output;
+	} counted;
+
+	struct {
+		struct ivi_output *output;
+		struct wl_list link;	/* ivi_output::mru */
+	} mru;
+
 	struct {
 		enum ivi_surface_flags flags;
 		int32_t x, y;
 		int32_t width, height;
+		struct wl_list link;	/* ivi_compositor::layout_txn */
 	} pending;
+
+	struct {
+		struct wl_list link;	/* ivi_compositor::warm_cache */
+		struct ivi_output *output;
+		uint64_t bytes;
+		/* when the activation was requested, if it had to wait */
+		struct timespec activate_start;
+	} warm;
+
+	struct {
+		/* as of the last repaint of its output */
+		bool occluded;
+		struct wl_list callbacks;	/* wl_callback resources */
+		struct wl_list link;	/* ivi_compositor::throttle */
+	} throttle;
+
+	/* output of the last activation request, for policies which only
+	 * come up with a verdict later on */
+	struct ivi_output *activate_output;
+
+	/* for policies deciding on app_id alone, dropped whenever the
+	 * app_id changes */
+	struct {
+		bool valid;
+		bool allowed;
+	} policy_verdict;
+
 	bool activated_by_default;
 	bool advertised_on_launch;
 	bool checked_pending;
@@ -344,6 +466,9 @@ to_ivi_surface(struct weston_surface *surface);
 void
 ivi_layout_set_mapped(struct ivi_surface *surface);
 
+void
+ivi_layout_set_unmapped(struct ivi_surface *surface);
+
 void
 ivi_layout_set_position(struct ivi_surface *surface,
 			int32_t x, int32_t y,
@@ -352,9 +477,48 @@ ivi_layout_set_position(struct ivi_surface *surface,
 struct ivi_surface *
 ivi_find_app(struct ivi_compositor *ivi, const char *app_id);
 
+uint32_t
+ivi_app_id_hash(const char *app_id);
+
+void
+ivi_app_id_index_add(struct ivi_surface *surf);
+
+void
+ivi_app_id_index_remove(struct ivi_surface *surf);
+
+void
+ivi_app_id_index_update(struct ivi_surface *surf);
+
+void
+ivi_surface_role_track(struct ivi_surface *surf);
+
+void
+ivi_surface_role_untrack(struct ivi_surface *surf);
+
 void
 ivi_layout_commit(struct ivi_compositor *ivi);
 
+bool
+ivi_layout_transaction_surface_committed(struct ivi_surface *surface);
+
+void
+ivi_layout_transaction_remove_surface(struct ivi_surface *surface);
+
+void
+ivi_layout_warm_cache_remove(struct ivi_surface *surface);
+
+void
+ivi_layout_mru_remove(struct ivi_surface *surface);
+
+void
+ivi_layout_throttle_output_init(struct ivi_output *output);
+
+void
+ivi_layout_throttle_committed(struct ivi_surface *surface);
+
+void
+ivi_layout_throttle_release(struct ivi_surface *surface);
+
 void
 ivi_layout_init(struct ivi_compositor *ivi, struct ivi_output *output);
 
@@ -377,11 +541,10 @@ void
 ivi_layout_split_committed(struct ivi_surface *surface);
 
 void
-ivi_layout_deactivate(struct ivi_compositor *ivi, const char *app_id);
+ivi_layout_split_removed(struct ivi_surface *surface);
 
 void
-ivi_layout_desktop_resize(struct ivi_surface *surface,
-			  struct weston_geometry area);
+ivi_layout_deactivate(struct ivi_compositor *ivi, const char *app_id);
 
 struct ivi_output *
 ivi_layout_get_output_from_surface(struct ivi_surface *surf);
@@ -408,6 +571,22 @@ shell_advertise_app_state(struct ivi_compositor *ivi, const char *app_id,
 void
 ivi_screenshooter_create(struct ivi_compositor *ivi);
 
+void
+ivi_tracer_create(struct ivi_compositor *ivi);
+
+void
+ivi_tracer_activate_request(struct ivi_compositor *ivi, const char *app_id);
+
+void
+ivi_tracer_configure(struct ivi_surface *surf);
+
+void
+ivi_tracer_commit(struct ivi_surface *surf);
+
+void
+ivi_tracer_activate_complete(struct ivi_surface *surf,
+			     struct ivi_output *output);
+
 void
 ivi_seat_init(struct ivi_compositor *ivi);
 
@@ -423,4 +602,7 @@ ivi_destroy_waltham_destroy(struct ivi_surface *surface);
 bool
 ivi_check_pending_surface(struct ivi_surface *surface);
 
+void
+ivi_remove_pending_desktop_surfaces(struct ivi_output *ioutput);
+
 #endif
@@ -28,9 +28,11 @@
 #include "shared/helpers.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include <libweston/libweston.h>
+#include <libweston/weston-log.h>
 #include <libweston-desktop/libweston-desktop.h>
 
 #include "agl-shell-desktop-server-protocol.h"
@@ -170,21 +172,590 @@ ivi_layout_init(struct ivi_compositor *ivi, struct ivi_output *output)
 		   output->area.x, output->area.y);
 }
 
+/* FNV-1a, a NULL app_id hashes the same as an empty one */
+uint32_t
+ivi_app_id_hash(const char *app_id)
+{
+	uint32_t hash = 2166136261u;
+
+	if (!app_id)
+		return hash;
+
+	while (*app_id) {
+		hash ^= (uint8_t) *app_id++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static struct wl_list *
+ivi_app_id_bucket(struct ivi_compositor *ivi, uint32_t hash)
+{
+	return &ivi->app_ids[hash & (IVI_APP_ID_HASH_SIZE - 1)];
+}
+
+/*
+ * Adds the surface to the app_id index. This should mirror the surface being
+ * added to ivi_compositor::surfaces. Surfaces without an app_id are indexed as
+ * well, such that they can be re-keyed once the client sets one.
+ */
+void
+ivi_app_id_index_add(struct ivi_surface *surf)
+{
+	struct wl_list *bucket =
+		ivi_app_id_bucket(surf->ivi, surf->app_id_hash);
+
+	wl_list_remove(&surf->app_id_link);
+	wl_list_insert(bucket, &surf->app_id_link);
+}
+
+void
+ivi_app_id_index_remove(struct ivi_surface *surf)
+{
+	wl_list_remove(&surf->app_id_link);
+	wl_list_init(&surf->app_id_link);
+}
+
+/*
+ * Clients can set (or change) their app_id at any point in time, so this
+ * verifies if the app_id still matches our copy and re-keys the surface in
+ * case it doesn't.
+ */
+void
+ivi_app_id_index_update(struct ivi_surface *surf)
+{
+	const char *app_id = weston_desktop_surface_get_app_id(surf->dsurface);
+
+	if (app_id == surf->app_id ||
+	    (app_id && surf->app_id && strcmp(app_id, surf->app_id) == 0))
+		return;
+
+	free(surf->app_id);
+	surf->app_id = app_id ? strdup(app_id) : NULL;
+	surf->app_id_hash = ivi_app_id_hash(surf->app_id);
+	surf->policy_verdict.valid = false;
+
+	if (!wl_list_empty(&surf->app_id_link))
+		ivi_app_id_index_add(surf);
+}
+
+/*
+ * Accounts the surface in the per-role counters, once it has been given a
+ * role and added to ivi_compositor::surfaces.
+ */
+void
+ivi_surface_role_track(struct ivi_surface *surf)
+{
+	struct ivi_output *output = NULL;
+
+	ivi_surface_role_untrack(surf);
+
+	if (surf->role != IVI_SURFACE_ROLE_DESKTOP)
+		output = ivi_layout_get_output_from_surface(surf);
+
+	surf->counted.tracked = true;
+	surf->counted.role = surf->role;
+	surf->counted.output = output;
+
+	surf->ivi->role_count[surf->role]++;
+	if (output)
+		output->role_count[surf->role]++;
+}
+
+void
+ivi_surface_role_untrack(struct ivi_surface *surf)
+{
+	if (!surf->counted.tracked)
+		return;
+
+	surf->ivi->role_count[surf->counted.role]--;
+	if (surf->counted.output)
+		surf->counted.output->role_count[surf->counted.role]--;
+
+	surf->counted.tracked = false;
+	surf->counted.output = NULL;
+}
+
 struct ivi_surface *
 ivi_find_app(struct ivi_compositor *ivi, const char *app_id)
 {
 	struct ivi_surface *surf;
-	const char *id;
+	uint32_t hash;
 
-	wl_list_for_each(surf, &ivi->surfaces, link) {
-		id = weston_desktop_surface_get_app_id(surf->dsurface);
-		if (id && strcmp(app_id, id) == 0)
+	if (!app_id)
+		return NULL;
+
+	hash = ivi_app_id_hash(app_id);
+	wl_list_for_each(surf, ivi_app_id_bucket(ivi, hash), app_id_link) {
+		if (surf->app_id_hash == hash && surf->app_id &&
+		    strcmp(app_id, surf->app_id) == 0)
 			return surf;
 	}
 
 	return NULL;
 }
 
+static void
+ivi_layout_warm_cache_unlink(struct ivi_surface *surf)
+{
+	struct ivi_compositor *ivi = surf->ivi;
+
+	ivi->warm_cache.count--;
+	ivi->warm_cache.bytes -= surf->warm.bytes;
+
+	surf->warm.bytes = 0;
+	surf->warm.output = NULL;
+	wl_list_remove(&surf->warm.link);
+	wl_list_init(&surf->warm.link);
+}
+
+/*
+ * Drops the surface from the cache, without touching its view. Used when the
+ * surface gets activated again or is destroyed.
+ */
+void
+ivi_layout_warm_cache_remove(struct ivi_surface *surface)
+{
+	if (wl_list_empty(&surface->warm.link))
+		return;
+
+	ivi_layout_warm_cache_unlink(surface);
+}
+
+static void
+ivi_layout_warm_cache_evict(struct ivi_compositor *ivi)
+{
+	while (!wl_list_empty(&ivi->warm_cache.surfaces) &&
+	       (ivi->warm_cache.count > ivi->warm_cache.max_count ||
+		ivi->warm_cache.bytes > ivi->warm_cache.max_bytes)) {
+		struct ivi_surface *surf =
+			wl_container_of(ivi->warm_cache.surfaces.prev,
+					surf, warm.link);
+		struct weston_view *view = surf->view;
+
+		weston_log_scope_printf(ivi->warm_cache.scope,
+					"evict app_id %s, %"PRIu64" KiB\n",
+					surf->app_id, surf->warm.bytes / 1024);
+
+		ivi_layout_warm_cache_unlink(surf);
+
+		view->is_mapped = false;
+		view->surface->is_mapped = false;
+		weston_layer_entry_remove(&view->layer_link);
+	}
+}
+
+/*
+ * Instead of unmapping a desktop surface being replaced by another one, keep
+ * it around in the hidden layer, maximized at the size of the output, so a
+ * later activation can complete straight away. Returns false if the surface
+ * can't be cached, in which case the caller should unmap it.
+ */
+static bool
+ivi_layout_warm_cache_park(struct ivi_output *output, struct ivi_surface *surf)
+{
+	struct ivi_compositor *ivi = output->ivi;
+	struct weston_view *view = surf->view;
+
+	if (ivi->warm_cache.max_count <= 0 ||
+	    surf->role != IVI_SURFACE_ROLE_DESKTOP)
+		return false;
+
+	if (weston_view_is_mapped(view))
+		weston_layer_entry_remove(&view->layer_link);
+	weston_layer_entry_insert(&ivi->hidden.view_list, &view->layer_link);
+
+	ivi_layout_warm_cache_remove(surf);
+
+	surf->warm.output = output;
+	surf->warm.bytes = (uint64_t) output->area.width *
+			   output->area.height * 4;
+	wl_list_insert(&ivi->warm_cache.surfaces, &surf->warm.link);
+	ivi->warm_cache.count++;
+	ivi->warm_cache.bytes += surf->warm.bytes;
+
+	weston_log_scope_printf(ivi->warm_cache.scope,
+				"park app_id %s, cached %d/%d, %"PRIu64" KiB\n",
+				surf->app_id, ivi->warm_cache.count,
+				ivi->warm_cache.max_count,
+				ivi->warm_cache.bytes / 1024);
+
+	ivi_layout_warm_cache_evict(ivi);
+	return true;
+}
+
+/*
+ * Asks the cached surfaces of an output to follow the usable area of that
+ * output, whenever it changes.
+ */
+static void
+ivi_layout_warm_cache_reconfigure(struct ivi_output *output)
+{
+	struct ivi_compositor *ivi = output->ivi;
+	struct ivi_surface *surf;
+
+	wl_list_for_each(surf, &ivi->warm_cache.surfaces, warm.link) {
+		struct weston_geometry geom;
+
+		if (surf->warm.output != output)
+			continue;
+
+		ivi->warm_cache.bytes -= surf->warm.bytes;
+		surf->warm.bytes = (uint64_t) output->area.width *
+				   output->area.height * 4;
+		ivi->warm_cache.bytes += surf->warm.bytes;
+
+		geom = weston_desktop_surface_get_geometry(surf->dsurface);
+		if (geom.width != output->area.width ||
+		    geom.height != output->area.height) {
+			weston_desktop_surface_set_size(surf->dsurface,
+							output->area.width,
+							output->area.height);
+			ivi_layout_throttle_release(surf);
+		}
+	}
+
+	ivi_layout_warm_cache_evict(ivi);
+}
+
+/*
+ * An activation is a hit if the surface is already at the right size and can
+ * be shown straight away, a miss if we need to wait for the client.
+ */
+static void
+ivi_layout_warm_cache_report(struct ivi_surface *surf, bool hit)
+{
+	struct ivi_compositor *ivi = surf->ivi;
+
+	if (hit) {
+		ivi->warm_cache.hits++;
+	} else {
+		ivi->warm_cache.misses++;
+		weston_compositor_read_presentation_clock(ivi->compositor,
+							  &surf->warm.activate_start);
+	}
+
+	weston_log_scope_printf(ivi->warm_cache.scope,
+				"%s app_id %s, hits %u, misses %u\n",
+				hit ? "hit" : "miss", surf->app_id,
+				ivi->warm_cache.hits, ivi->warm_cache.misses);
+}
+
+static void
+ivi_layout_warm_cache_report_latency(struct ivi_surface *surf)
+{
+	struct ivi_compositor *ivi = surf->ivi;
+	struct timespec *start = &surf->warm.activate_start;
+	struct timespec now;
+	int64_t latency_us;
+
+	if (start->tv_sec == 0 && start->tv_nsec == 0)
+		return;
+
+	weston_compositor_read_presentation_clock(ivi->compositor, &now);
+	latency_us = (now.tv_sec - start->tv_sec) * 1000000LL +
+		     (now.tv_nsec - start->tv_nsec) / 1000;
+
+	weston_log_scope_printf(ivi->warm_cache.scope,
+				"app_id %s activated after %"PRId64" us\n",
+				surf->app_id, latency_us);
+
+	start->tv_sec = 0;
+	start->tv_nsec = 0;
+}
+
+/*
+ * Frame callbacks of surfaces which are fully occluded, by the layers above
+ * them or by being parked in the hidden layer, are held back and only sent
+ * out at the rate set with 'occluded-frame-rate', such that clients nobody
+ * can see don't keep rendering at full rate.
+ */
+static bool
+ivi_layout_throttle_exempt(struct ivi_surface *surf)
+{
+	/* these are waiting on the client to catch up */
+	if (!wl_list_empty(&surf->pending.link))
+		return true;
+
+	if (surf->role == IVI_SURFACE_ROLE_DESKTOP &&
+	    surf->desktop.pending_output)
+		return true;
+
+	return false;
+}
+
+static bool
+ivi_layout_surface_occluded(struct ivi_surface *surf)
+{
+	struct weston_view *view = surf->view;
+	pixman_region32_t visible;
+	bool occluded;
+
+	if (!weston_view_is_mapped(view))
+		return false;
+
+	if (view->layer_link.layer == &surf->ivi->hidden)
+		return true;
+
+	/* the clip holds what the views above covered in the last repaint */
+	pixman_region32_init(&visible);
+	pixman_region32_subtract(&visible, &view->transform.boundingbox,
+				 &view->clip);
+	occluded = !pixman_region32_not_empty(&visible);
+	pixman_region32_fini(&visible);
+
+	return occluded;
+}
+
+static void
+ivi_layout_throttle_flush(struct ivi_surface *surf)
+{
+	struct wl_resource *cb, *cb_tmp;
+	struct timespec now;
+	uint32_t msecs;
+
+	if (wl_list_empty(&surf->throttle.callbacks))
+		return;
+
+	weston_compositor_read_presentation_clock(surf->ivi->compositor, &now);
+	msecs = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+	wl_resource_for_each_safe(cb, cb_tmp, &surf->throttle.callbacks) {
+		wl_callback_send_done(cb, msecs);
+		wl_resource_destroy(cb);
+	}
+
+	wl_list_init(&surf->throttle.callbacks);
+	wl_list_remove(&surf->throttle.link);
+	wl_list_init(&surf->throttle.link);
+}
+
+static int
+ivi_layout_throttle_timeout(void *data)
+{
+	struct ivi_compositor *ivi = data;
+	struct ivi_surface *surf, *tmp;
+
+	wl_list_for_each_safe(surf, tmp, &ivi->throttle.surfaces, throttle.link)
+		ivi_layout_throttle_flush(surf);
+
+	return 0;
+}
+
+/*
+ * Sends out the frame callbacks held back, and lets the surface run at full
+ * rate until its output is repainted again. Used when the surface becomes
+ * visible, or is asked to draw at a new size, or goes away.
+ */
+void
+ivi_layout_throttle_release(struct ivi_surface *surface)
+{
+	surface->throttle.occluded = false;
+	ivi_layout_throttle_flush(surface);
+}
+
+void
+ivi_layout_throttle_committed(struct ivi_surface *surface)
+{
+	struct ivi_compositor *ivi = surface->ivi;
+	struct weston_surface *wsurface =
+		weston_desktop_surface_get_surface(surface->dsurface);
+
+	if (ivi->throttle.rate < 0 || !surface->throttle.occluded ||
+	    ivi_layout_throttle_exempt(surface))
+		return;
+
+	/*
+	 * We're called from within the commit, before libweston moves the
+	 * callbacks of this commit out of the pending state, so take them
+	 * from there. Those left over from earlier commits go along too.
+	 */
+	wl_list_insert_list(surface->throttle.callbacks.prev,
+			    &wsurface->frame_callback_list);
+	wl_list_init(&wsurface->frame_callback_list);
+	wl_list_insert_list(surface->throttle.callbacks.prev,
+			    &wsurface->pending.frame_callback_list);
+	wl_list_init(&wsurface->pending.frame_callback_list);
+
+	if (wl_list_empty(&surface->throttle.callbacks))
+		return;
+
+	if (!wl_list_empty(&surface->throttle.link))
+		return;
+
+	if (wl_list_empty(&ivi->throttle.surfaces) && ivi->throttle.rate > 0) {
+		if (!ivi->throttle.timer) {
+			struct wl_event_loop *loop =
+				wl_display_get_event_loop(ivi->compositor->wl_display);
+
+			ivi->throttle.timer =
+				wl_event_loop_add_timer(loop,
+							ivi_layout_throttle_timeout,
+							ivi);
+		}
+
+		if (ivi->throttle.timer)
+			wl_event_source_timer_update(ivi->throttle.timer,
+						     1000 / ivi->throttle.rate);
+	}
+
+	wl_list_insert(&ivi->throttle.surfaces, &surface->throttle.link);
+}
+
+static void
+ivi_layout_throttle_output_frame(struct wl_listener *listener, void *data)
+{
+	struct ivi_output *output =
+		wl_container_of(listener, output, frame_listener);
+	struct ivi_compositor *ivi = output->ivi;
+	struct ivi_surface *surf;
+
+	if (ivi->throttle.rate < 0)
+		return;
+
+	wl_list_for_each(surf, &ivi->surfaces, link) {
+		bool occluded;
+
+		if (surf->view->output != output->output)
+			continue;
+
+		occluded = !ivi_layout_throttle_exempt(surf) &&
+			   ivi_layout_surface_occluded(surf);
+
+		/* back to full rate as soon as it can be seen again */
+		if (!occluded)
+			ivi_layout_throttle_flush(surf);
+
+		surf->throttle.occluded = occluded;
+	}
+}
+
+void
+ivi_layout_throttle_output_init(struct ivi_output *output)
+{
+	output->frame_listener.notify = ivi_layout_throttle_output_frame;
+	wl_signal_add(&output->output->frame_signal, &output->frame_listener);
+}
+
+static uint64_t
+ivi_layout_region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *boxes;
+	uint64_t area = 0;
+	int n_boxes;
+
+	boxes = pixman_region32_rectangles(region, &n_boxes);
+	for (int i = 0; i < n_boxes; i++)
+		area += (uint64_t) (boxes[i].x2 - boxes[i].x1) *
+			(boxes[i].y2 - boxes[i].y1);
+
+	return area;
+}
+
+/*
+ * Damages what changes on screen when 'view' replaces 'old_view'. Unless
+ * the new view is opaque and has the same geometry as the old one, that's
+ * the area of both views. Otherwise nothing but the contents of the view
+ * change: the layers beneath it stay hidden and those above it are left as
+ * they are, so the parts covered by opaque views above it needn't be
+ * repainted. This only relies on the geometry of the views, as the damage
+ * of the commit which might come along with the switch hasn't been applied
+ * to the surface yet.
+ */
+static void
+ivi_layout_damage_switch(struct ivi_output *output,
+			 struct weston_view *old_view, struct weston_view *view)
+{
+	struct ivi_compositor *ivi = output->ivi;
+	struct weston_compositor *ec = ivi->compositor;
+	pixman_region32_t damage, region, full;
+	uint64_t damaged, saved;
+
+	pixman_region32_init(&damage);
+	pixman_region32_init(&region);
+	pixman_region32_init(&full);
+
+	pixman_region32_copy(&full, &view->transform.boundingbox);
+	if (old_view && old_view != view)
+		pixman_region32_union(&full, &full,
+				      &old_view->transform.boundingbox);
+
+	pixman_region32_subtract(&region, &view->transform.boundingbox,
+				 &view->transform.opaque);
+
+	if (old_view && old_view != view &&
+	    !pixman_region32_not_empty(&region) &&
+	    pixman_region32_equal(&old_view->transform.boundingbox,
+				  &view->transform.boundingbox)) {
+		struct weston_layer *layer;
+		struct weston_view *above;
+
+		pixman_region32_clear(&region);
+		wl_list_for_each(layer, &ec->layer_list, link) {
+			if (layer == &ivi->normal)
+				break;
+
+			wl_list_for_each(above, &layer->view_list.link,
+					 layer_link.link)
+				pixman_region32_union(&region, &region,
+						      &above->transform.opaque);
+		}
+
+		pixman_region32_subtract(&damage, &view->transform.boundingbox,
+					 &region);
+	} else {
+		pixman_region32_copy(&damage, &full);
+	}
+
+	pixman_region32_union(&ec->primary_plane.damage,
+			      &ec->primary_plane.damage, &damage);
+	weston_output_schedule_repaint(output->output);
+
+	damaged = ivi_layout_region_area(&damage);
+	saved = ivi_layout_region_area(&full) - damaged;
+	output->switch_damage_saved += saved;
+
+	weston_log_scope_printf(ivi->switch_damage_scope,
+				"Switch damage on output %s: %"PRIu64
+				" pixels, saved %"PRIu64" (%"PRIu64" in total)\n",
+				output->name, damaged, saved,
+				output->switch_damage_saved);
+
+	pixman_region32_fini(&full);
+	pixman_region32_fini(&region);
+	pixman_region32_fini(&damage);
+}
+
+void
+ivi_layout_mru_remove(struct ivi_surface *surface)
+{
+	if (!surface->mru.output)
+		return;
+
+	surface->mru.output->mru_len--;
+	surface->mru.output = NULL;
+	wl_list_remove(&surface->mru.link);
+	wl_list_init(&surface->mru.link);
+}
+
+static void
+ivi_layout_mru_push(struct ivi_output *output, struct ivi_surface *surf)
+{
+	ivi_layout_mru_remove(surf);
+
+	wl_list_insert(&output->mru, &surf->mru.link);
+	surf->mru.output = output;
+	output->mru_len++;
+
+	if (output->mru_len > IVI_OUTPUT_MRU_SIZE) {
+		struct ivi_surface *oldest =
+			wl_container_of(output->mru.prev, oldest, mru.link);
+
+		ivi_layout_mru_remove(oldest);
+	}
+}
+
 static void
 ivi_layout_activate_complete(struct ivi_output *output,
 			     struct ivi_surface *surf)
@@ -192,6 +763,11 @@ ivi_layout_activate_complete(struct ivi_output *output,
 	struct ivi_compositor *ivi = output->ivi;
 	struct weston_output *woutput = output->output;
 	struct weston_view *view = surf->view;
+	struct weston_view *old_view = NULL;
+
+	ivi_layout_warm_cache_remove(surf);
+	ivi_layout_warm_cache_report_latency(surf);
+	ivi_layout_throttle_release(surf);
 
 	if (weston_view_is_mapped(view)) {
 		weston_layer_entry_remove(&view->layer_link);
@@ -205,19 +781,25 @@ ivi_layout_activate_complete(struct ivi_output *output,
 	view->is_mapped = true;
 	view->surface->is_mapped = true;
 
-	if (output->active) {
+	if (output->active)
+		old_view = output->active->view;
+
+	if (output->active &&
+	    !ivi_layout_warm_cache_park(output, output->active)) {
 		output->active->view->is_mapped = false;
 		output->active->view->surface->is_mapped = false;
 
 		weston_layer_entry_remove(&output->active->view->layer_link);
 	}
-	output->previous_active = output->active;
 	output->active = surf;
+	ivi_layout_mru_push(output, surf);
 
 	weston_layer_entry_insert(&ivi->normal.view_list, &view->layer_link);
 	weston_view_update_transform(view);
 
-	weston_view_damage_below(view);
+	ivi_layout_damage_switch(output, old_view, view);
+
+	ivi_tracer_activate_complete(surf, output);
 
 	/*
 	 * the 'remote' role now makes use of this part so make sure we don't
@@ -239,12 +821,16 @@ struct ivi_output *
 ivi_layout_find_with_app_id(const char *app_id, struct ivi_compositor *ivi)
 {
 	struct ivi_output *out;
+	uint32_t hash;
 
 	if (!app_id)
 		return NULL;
 
+	/* the number of outputs is bounded by the number of heads, so
+	 * comparing the hashes first avoids most of the string compares */
+	hash = ivi_app_id_hash(app_id);
 	wl_list_for_each(out, &ivi->outputs, link) {
-		if (!out->app_id)
+		if (!out->app_id || out->app_id_hash != hash)
 			continue;
 
 		if (!strcmp(app_id, out->app_id))
@@ -269,6 +855,334 @@ ivi_layout_find_bg_output(struct ivi_compositor *ivi)
 	return NULL;
 }
 
+/*
+ * Layout transactions: position, size and mapping changes for any number of
+ * surfaces, on any number of outputs, are staged with
+ * ivi_layout_set_position(), ivi_layout_set_mapped() and
+ * ivi_layout_set_unmapped(), and sent out to
+ * clients with ivi_layout_commit(). Nothing is changed on screen until every
+ * surface involved committed a buffer matching the size it was asked for
+ * (or IVI_LAYOUT_TXN_TIMEOUT_MS passed), after which all of them are placed
+ * at once, such that the result lands in a single repaint.
+ */
+#define IVI_LAYOUT_TXN_TIMEOUT_MS	200
+
+static struct weston_layer *
+ivi_layout_get_surface_layer(struct ivi_surface *surf)
+{
+	struct ivi_compositor *ivi = surf->ivi;
+
+	switch (surf->role) {
+	case IVI_SURFACE_ROLE_POPUP:
+		return &ivi->popup;
+	case IVI_SURFACE_ROLE_FULLSCREEN:
+		return &ivi->fullscreen;
+	default:
+		return &ivi->normal;
+	}
+}
+
+static void
+ivi_layout_transaction_stage(struct ivi_surface *surf)
+{
+	/* in case it is already in flight, it will be sent out again */
+	wl_list_remove(&surf->pending.link);
+	wl_list_insert(surf->ivi->layout_txn.staged.prev, &surf->pending.link);
+}
+
+void
+ivi_layout_set_position(struct ivi_surface *surface,
+			int32_t x, int32_t y,
+			int32_t width, int32_t height)
+{
+	surface->pending.flags |= IVI_SURFACE_PROP_POSITION;
+	surface->pending.x = x;
+	surface->pending.y = y;
+	surface->pending.width = width;
+	surface->pending.height = height;
+
+	ivi_layout_transaction_stage(surface);
+}
+
+void
+ivi_layout_set_mapped(struct ivi_surface *surface)
+{
+	surface->pending.flags &= ~IVI_SURFACE_PROP_UNMAP;
+	surface->pending.flags |= IVI_SURFACE_PROP_MAP;
+
+	ivi_layout_transaction_stage(surface);
+}
+
+/* taken off screen together with the rest of the transaction */
+void
+ivi_layout_set_unmapped(struct ivi_surface *surface)
+{
+	surface->pending.flags &= ~(IVI_SURFACE_PROP_MAP |
+				    IVI_SURFACE_PROP_POSITION);
+	surface->pending.flags |= IVI_SURFACE_PROP_UNMAP;
+
+	ivi_layout_transaction_stage(surface);
+}
+
+static bool
+ivi_layout_transaction_surface_ready(struct ivi_surface *surf)
+{
+	struct weston_geometry geom;
+
+	if (!(surf->pending.flags & IVI_SURFACE_PROP_POSITION))
+		return true;
+
+	geom = weston_desktop_surface_get_geometry(surf->dsurface);
+	return geom.width == surf->pending.width &&
+	       geom.height == surf->pending.height;
+}
+
+static void
+ivi_layout_transaction_apply(struct ivi_compositor *ivi)
+{
+	struct ivi_surface *surf, *tmp;
+
+	/* might not have been created yet, or failed to */
+	if (ivi->layout_txn.timer)
+		wl_event_source_timer_update(ivi->layout_txn.timer, 0);
+
+	wl_list_for_each_safe(surf, tmp, &ivi->layout_txn.in_flight,
+			      pending.link) {
+		struct weston_view *view = surf->view;
+
+		/* damage the previous place of the view */
+		if (weston_view_is_mapped(view))
+			weston_view_damage_below(view);
+
+		if (surf->pending.flags & IVI_SURFACE_PROP_UNMAP) {
+			struct ivi_output *output =
+				ivi_layout_get_output_from_surface(surf);
+
+			/* a parked surface is mapped in the hidden layer */
+			ivi_layout_warm_cache_remove(surf);
+
+			if (weston_view_is_mapped(view))
+				weston_layer_entry_remove(&view->layer_link);
+			view->is_mapped = false;
+			view->surface->is_mapped = false;
+
+			if (output && output->active == surf)
+				output->active = NULL;
+
+			goto done;
+		}
+
+		if (surf->pending.flags & IVI_SURFACE_PROP_POSITION)
+			weston_view_set_position(view, surf->pending.x,
+						 surf->pending.y);
+
+		if (surf->pending.flags & IVI_SURFACE_PROP_MAP) {
+			struct ivi_output *output =
+				ivi_layout_get_output_from_surface(surf);
+			struct weston_layer *layer =
+				ivi_layout_get_surface_layer(surf);
+
+			if (weston_view_is_mapped(view))
+				weston_layer_entry_remove(&view->layer_link);
+
+			/* same bookkeeping as a regular activation, the
+			 * surface staying active if it is still mapped, or
+			 * the first one mapped taking over otherwise */
+			if (surf->role == IVI_SURFACE_ROLE_DESKTOP) {
+				ivi_layout_warm_cache_remove(surf);
+				ivi_layout_throttle_release(surf);
+
+				if (output) {
+					ivi_layout_mru_push(output, surf);
+					if (!output->active)
+						output->active = surf;
+				}
+			}
+
+			if (output)
+				weston_view_set_output(view, output->output);
+			weston_layer_entry_insert(&layer->view_list,
+						  &view->layer_link);
+
+			view->is_mapped = true;
+			view->surface->is_mapped = true;
+
+			shell_advertise_app_state(ivi, surf->app_id, NULL,
+						  AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED);
+
+			weston_log("Activation completed for app_id %s, role %s, output %s\n",
+				   surf->app_id,
+				   ivi_layout_get_surface_role_name(surf),
+				   output ? output->name : "none");
+		}
+
+		weston_view_update_transform(view);
+		weston_view_damage_below(view);
+
+done:
+		surf->pending.flags = 0;
+		wl_list_remove(&surf->pending.link);
+		wl_list_init(&surf->pending.link);
+	}
+
+	weston_compositor_schedule_repaint(ivi->compositor);
+}
+
+static void
+ivi_layout_transaction_try_apply(struct ivi_compositor *ivi)
+{
+	struct ivi_surface *surf;
+
+	if (wl_list_empty(&ivi->layout_txn.in_flight))
+		return;
+
+	wl_list_for_each(surf, &ivi->layout_txn.in_flight, pending.link)
+		if (!ivi_layout_transaction_surface_ready(surf))
+			return;
+
+	ivi_layout_transaction_apply(ivi);
+}
+
+static int
+ivi_layout_transaction_timeout(void *data)
+{
+	struct ivi_compositor *ivi = data;
+	struct ivi_surface *surf;
+
+	wl_list_for_each(surf, &ivi->layout_txn.in_flight, pending.link)
+		if (!ivi_layout_transaction_surface_ready(surf))
+			weston_log("Layout transaction timed out waiting for "
+				   "app_id %s, role %s\n", surf->app_id,
+				   ivi_layout_get_surface_role_name(surf));
+
+	ivi_layout_transaction_apply(ivi);
+	return 0;
+}
+
+/*
+ * Sends out the configure events for all staged changes. These are applied
+ * together with the ones already in flight, if any.
+ */
+void
+ivi_layout_commit(struct ivi_compositor *ivi)
+{
+	struct ivi_surface *surf, *tmp;
+
+	wl_list_for_each_safe(surf, tmp, &ivi->layout_txn.staged,
+			      pending.link) {
+		struct weston_view *view = surf->view;
+
+		if (!ivi_layout_transaction_surface_ready(surf))
+			weston_desktop_surface_set_size(surf->dsurface,
+							surf->pending.width,
+							surf->pending.height);
+		ivi_layout_throttle_release(surf);
+
+		/*
+		 * Similar to activation, place views not yet mapped on the
+		 * hidden layer so they keep receiving frame events and are able
+		 * to act on our configure event.
+		 */
+		if ((surf->pending.flags & IVI_SURFACE_PROP_MAP) &&
+		    !weston_view_is_mapped(view)) {
+			struct ivi_output *output =
+				ivi_layout_get_output_from_surface(surf);
+
+			view->is_mapped = true;
+			view->surface->is_mapped = true;
+
+			if (output)
+				weston_view_set_output(view, output->output);
+			weston_layer_entry_insert(&ivi->hidden.view_list,
+						  &view->layer_link);
+		}
+
+		wl_list_remove(&surf->pending.link);
+		wl_list_insert(ivi->layout_txn.in_flight.prev,
+			       &surf->pending.link);
+	}
+
+	if (wl_list_empty(&ivi->layout_txn.in_flight))
+		return;
+
+	if (!ivi->layout_txn.timer) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(ivi->compositor->wl_display);
+
+		ivi->layout_txn.timer =
+			wl_event_loop_add_timer(loop,
+						ivi_layout_transaction_timeout,
+						ivi);
+		if (!ivi->layout_txn.timer) {
+			ivi_layout_transaction_apply(ivi);
+			return;
+		}
+	}
+
+	wl_event_source_timer_update(ivi->layout_txn.timer,
+				     IVI_LAYOUT_TXN_TIMEOUT_MS);
+	ivi_layout_transaction_try_apply(ivi);
+}
+
+/*
+ * Returns true if the surface is part of a layout transaction, in which case
+ * it will be placed once the transaction completes.
+ */
+bool
+ivi_layout_transaction_surface_committed(struct ivi_surface *surface)
+{
+	if (wl_list_empty(&surface->pending.link))
+		return false;
+
+	ivi_layout_transaction_try_apply(surface->ivi);
+	return true;
+}
+
+void
+ivi_layout_transaction_remove_surface(struct ivi_surface *surface)
+{
+	struct ivi_compositor *ivi = surface->ivi;
+
+	if (wl_list_empty(&surface->pending.link))
+		return;
+
+	surface->pending.flags = 0;
+	wl_list_remove(&surface->pending.link);
+	wl_list_init(&surface->pending.link);
+
+	/* it might have been the one we were waiting on */
+	ivi_layout_transaction_try_apply(ivi);
+}
+
+/*
+ * Fits the active surface of each output back into the usable area of that
+ * output.
+ */
+void
+ivi_reflow_outputs(struct ivi_compositor *ivi)
+{
+	struct ivi_output *output;
+
+	wl_list_for_each(output, &ivi->outputs, link) {
+		struct weston_output *woutput = output->output;
+
+		if (!woutput)
+			continue;
+
+		ivi_layout_warm_cache_reconfigure(output);
+		if (!output->active)
+			continue;
+
+		ivi_layout_set_position(output->active,
+					woutput->x + output->area.x,
+					woutput->y + output->area.y,
+					output->area.width,
+					output->area.height);
+	}
+
+	ivi_layout_commit(ivi);
+}
+
 void
 ivi_layout_desktop_committed(struct ivi_surface *surf)
 {
@@ -281,6 +1195,10 @@ ivi_layout_desktop_committed(struct ivi_surface *surf)
 	assert(surf->role == IVI_SURFACE_ROLE_DESKTOP ||
 	       surf->role == IVI_SURFACE_ROLE_REMOTE);
 
+	/* parked surfaces only keep up with their configure events */
+	if (!wl_list_empty(&surf->warm.link))
+		return;
+
 	/*
 	 * we can't make use here of the ivi_layout_get_output_from_surface()
 	 * due to the fact that we'll always land here when a surface performs
@@ -398,14 +1316,9 @@ ivi_layout_fullscreen_committed(struct ivi_surface *surface)
 	struct ivi_policy *policy = ivi->policy;
 
 	struct weston_desktop_surface *dsurface = surface->dsurface;
-	struct weston_surface *wsurface =
-		weston_desktop_surface_get_surface(dsurface);
-	const char *app_id = weston_desktop_surface_get_app_id(dsurface);
 
 	struct ivi_output *output = surface->split.output;
 	struct weston_output *woutput = output->output;
-
-	struct weston_view *view = surface->view;
 	struct weston_geometry geom;
 
 	if (policy && policy->api.surface_activate_by_default &&
@@ -424,41 +1337,83 @@ ivi_layout_fullscreen_committed(struct ivi_surface *surface)
 
 	weston_desktop_surface_set_fullscreen(dsurface, true);
 
-	weston_view_set_output(view, woutput);
-	weston_view_set_position(view, woutput->x, woutput->y);
-	weston_layer_entry_insert(&ivi->fullscreen.view_list, &view->layer_link);
+	/* only shown once the client re-drew itself at the output size */
+	ivi_layout_set_position(surface, woutput->x, woutput->y,
+				woutput->width, woutput->height);
+	ivi_layout_set_mapped(surface);
+	ivi_layout_commit(ivi);
+}
 
-	weston_view_update_transform(view);
-	weston_view_damage_below(view);
+static bool
+ivi_layout_geometry_equal(const struct weston_geometry *a,
+			  const struct weston_geometry *b)
+{
+	return a->x == b->x && a->y == b->y &&
+	       a->width == b->width && a->height == b->height;
+}
 
-	wsurface->is_mapped = true;
-	surface->view->is_mapped = true;
+/*
+ * Re-computes the geometry of the split panes of an output, as well as the
+ * usable area left for the other surfaces, and stages a layout change for
+ * the panes (and the active surface) whose geometry changed.
+ */
+static void
+ivi_layout_split_reflow(struct ivi_output *output)
+{
+	struct weston_output *woutput = output->output;
+	struct weston_geometry rest = output->area_full;
+	struct weston_geometry old_area = output->area;
+	struct ivi_surface *surf;
 
-	shell_advertise_app_state(ivi, app_id,
-				  NULL, AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED);
+	wl_list_for_each(surf, &output->split_panes, split.link) {
+		struct ivi_split_surface *pane = &surf->split;
+		struct weston_geometry geom;
+
+		switch (surf->role) {
+		case IVI_SURFACE_ROLE_SPLIT_V:
+			geom.width = rest.width * pane->ratio / 100;
+			geom.height = rest.height;
+			geom.x = rest.x + rest.width - geom.width;
+			geom.y = rest.y;
+
+			rest.width -= geom.width;
+			break;
+		case IVI_SURFACE_ROLE_SPLIT_H:
+			geom.width = rest.width;
+			geom.height = rest.height * pane->ratio / 100;
+			geom.x = rest.x;
+			geom.y = rest.y;
+
+			rest.y += geom.height;
+			rest.height -= geom.height;
+			break;
+		default:
+			assert(!"Invalid split orientation\n");
+		}
 
-	weston_log("Activation completed for app_id %s, role %s, output %s\n",
-			app_id, ivi_layout_get_surface_role_name(surface), output->name);
-}
+		geom.x += woutput->x;
+		geom.y += woutput->y;
 
-void
-ivi_layout_desktop_resize(struct ivi_surface *surface,
-			  struct weston_geometry area)
-{
-	struct weston_desktop_surface *dsurf = surface->dsurface;
-	struct weston_view *view = surface->view;
+		if (ivi_layout_geometry_equal(&geom, &pane->geom))
+			continue;
 
-	int x = area.x;
-	int y = area.y;
-	int width = area.width;
-	int height = area.height;
+		pane->geom = geom;
+		ivi_layout_set_position(surf, geom.x, geom.y,
+					geom.width, geom.height);
+	}
 
-	weston_desktop_surface_set_size(dsurf,
-					width, height);
+	output->area = rest;
+	if (ivi_layout_geometry_equal(&old_area, &output->area))
+		return;
 
-	weston_view_set_position(view, x, y);
-	weston_view_update_transform(view);
-	weston_view_damage_below(view);
+	ivi_layout_warm_cache_reconfigure(output);
+
+	if (output->active)
+		ivi_layout_set_position(output->active,
+					woutput->x + output->area.x,
+					woutput->y + output->area.y,
+					output->area.width,
+					output->area.height);
 }
 
 void
@@ -466,23 +1421,7 @@ ivi_layout_split_committed(struct ivi_surface *surface)
 {
 	struct ivi_compositor *ivi = surface->ivi;
 	struct ivi_policy *policy = ivi->policy;
-
-	struct weston_desktop_surface *dsurface = surface->dsurface;
-	struct weston_surface *wsurface =
-		weston_desktop_surface_get_surface(dsurface);
-	const char *app_id = weston_desktop_surface_get_app_id(dsurface);
-
 	struct ivi_output *output = surface->split.output;
-	struct weston_output *woutput = output->output;
-
-	struct weston_view *view = surface->view;
-	struct weston_geometry geom;
-
-	int x, y;
-	int width, height;
-
-	x = woutput->x;
-	y = woutput->y;
 
 	if (policy && policy->api.surface_activate_by_default &&
 	    !policy->api.surface_activate_by_default(surface, surface->ivi) &&
@@ -492,67 +1431,40 @@ ivi_layout_split_committed(struct ivi_surface *surface)
 	if (surface->view->is_mapped)
 		return;
 
-	geom = weston_desktop_surface_get_geometry(dsurface);
-
 	assert(surface->role == IVI_SURFACE_ROLE_SPLIT_H ||
 	       surface->role == IVI_SURFACE_ROLE_SPLIT_V);
 
-	/* save the previous area in order to recover it back when if this kind
-	 * of surface is being destroyed/removed */
-	output->area_saved = output->area;
-
-	switch (surface->role) {
-	case IVI_SURFACE_ROLE_SPLIT_V:
-		geom.width = (output->area.width / 2);
-
-		x += woutput->width - geom.width;
-		output->area.width -= geom.width;
-
-		width = woutput->width - x;
-		height = output->area.height;
-		y = output->area.y;
-
-		break;
-	case IVI_SURFACE_ROLE_SPLIT_H:
-		geom.height = (output->area.height / 2);
-
-		y = output->area.y;
-		output->area.y += geom.height;
-		output->area.height -= geom.height;
-
-		width = output->area.width;
-		height = output->area.height;
-
-		x = output->area.x;
-
-		break;
-	default:
-		assert(!"Invalid split orientation\n");
-	}
-
-	weston_desktop_surface_set_size(dsurface,
-					width, height);
+	/* the first pane splits the area the panels left over */
+	if (wl_list_empty(&output->split_panes))
+		output->area_full = output->area;
 
-	/* resize the active surface first, output->area already contains
-	 * correct area to resize to */
-	if (output->active)
-		ivi_layout_desktop_resize(output->active, output->area);
+	if (wl_list_empty(&surface->split.link))
+		wl_list_insert(output->split_panes.prev, &surface->split.link);
 
-	weston_view_set_output(view, woutput);
-	weston_view_set_position(view, x, y);
-	weston_layer_entry_insert(&ivi->normal.view_list, &view->layer_link);
+	/* resize the panes and the active surface, and map the new pane, all
+	 * in the same transaction */
+	ivi_layout_split_reflow(output);
+	ivi_layout_set_mapped(surface);
+	ivi_layout_commit(ivi);
+}
 
-	weston_view_update_transform(view);
-	weston_view_damage_below(view);
+/*
+ * Gives the area of a split surface going away back to the other panes and
+ * to the active surface.
+ */
+void
+ivi_layout_split_removed(struct ivi_surface *surface)
+{
+	struct ivi_output *output = surface->split.output;
 
-	wsurface->is_mapped = true;
-	surface->view->is_mapped = true;
+	if (wl_list_empty(&surface->split.link))
+		return;
 
-	shell_advertise_app_state(ivi, app_id,
-				  NULL, AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED);
+	wl_list_remove(&surface->split.link);
+	wl_list_init(&surface->split.link);
 
-	weston_log("Activation completed for app_id %s, role %s, output %s\n",
-			app_id, ivi_layout_get_surface_role_name(surface), output->name);
+	ivi_layout_split_reflow(output);
+	ivi_layout_commit(surface->ivi);
 }
 
 static void
@@ -648,9 +1560,6 @@ ivi_layout_popup_re_add(struct ivi_surface *surface)
 static bool
 ivi_layout_surface_is_split_or_fullscreen(struct ivi_surface *surf)
 {
-	struct ivi_compositor *ivi = surf->ivi;
-	struct ivi_surface *is;
-
 	if (surf->role != IVI_SURFACE_ROLE_SPLIT_H &&
 	    surf->role != IVI_SURFACE_ROLE_SPLIT_V &&
 	    surf->role != IVI_SURFACE_ROLE_FULLSCREEN)
@@ -661,11 +1570,7 @@ ivi_layout_surface_is_split_or_fullscreen(struct ivi_surface *surf)
 	if (!surf->activated_by_default)
 		surf->activated_by_default = true;
 
-	wl_list_for_each(is, &ivi->surfaces, link)
-		if (is == surf)
-			return true;
-
-	return false;
+	return surf->counted.tracked;
 }
 
 void
@@ -685,6 +1590,7 @@ ivi_layout_activate_by_surf(struct ivi_output *output, struct ivi_surface *surf)
 	if (!surf)
 		return;
 
+	surf->activate_output = output;
 	if (policy && policy->api.surface_activate &&
 	    !policy->api.surface_activate(surf, surf->ivi)) {
 		return;
@@ -723,14 +1629,19 @@ ivi_layout_activate_by_surf(struct ivi_output *output, struct ivi_surface *surf)
 	if (weston_desktop_surface_get_maximized(dsurf) &&
 	    geom.width == output->area.width &&
 	    geom.height == output->area.height) {
+		ivi_layout_warm_cache_report(surf, true);
 		ivi_layout_activate_complete(output, surf);
 		return;
 	}
 
+	ivi_layout_warm_cache_report(surf, false);
+
 	weston_desktop_surface_set_maximized(dsurf, true);
 	weston_desktop_surface_set_size(dsurf,
 					output->area.width,
 					output->area.height);
+	ivi_tracer_configure(surf);
+	ivi_layout_throttle_release(surf);
 
 	weston_log("Setting app_id %s, role %s, set to maximized (%dx%d)\n",
 			app_id, ivi_layout_get_surface_role_name(surf),
@@ -832,13 +1743,26 @@ ivi_layout_deactivate(struct ivi_compositor *ivi, const char *app_id)
 			ivi_layout_get_surface_role_name(surf));
 
 	if (surf->role == IVI_SURFACE_ROLE_DESKTOP) {
-		struct ivi_surface *previous_active;
+		struct ivi_surface *previous_active = NULL;
 
-		previous_active = ivi_output->previous_active;
+		/* it shouldn't be picked up when going back anymore */
+		ivi_layout_mru_remove(surf);
+		if (ivi_output->active != surf)
+			return;
+
+		if (!wl_list_empty(&ivi_output->mru))
+			previous_active = wl_container_of(ivi_output->mru.next,
+							  previous_active,
+							  mru.link);
 		if (!previous_active) {
 			/* we don't have a previous active it means we should
 			 * display the bg */
-			if (ivi_output->active) {
+			if (ivi_output->active &&
+			    ivi_layout_warm_cache_park(ivi_output,
+						       ivi_output->active)) {
+				weston_view_damage_below(ivi_output->active->view);
+				ivi_output->active = NULL;
+			} else if (ivi_output->active) {
 				struct weston_view *view;
 
 				view = ivi_output->active->view;
@@ -850,13 +1774,9 @@ ivi_layout_deactivate(struct ivi_compositor *ivi, const char *app_id)
 				ivi_output->active = NULL;
 			}
 		} else {
-			struct weston_desktop_surface *dsurface;
-			const char *previous_active_app_id;
-
-			dsurface = previous_active->dsurface;
-			previous_active_app_id =
-				weston_desktop_surface_get_app_id(dsurface);
-			ivi_layout_activate(ivi_output, previous_active_app_id);
+			/* a still configured (warm) surface will be shown
+			 * straight away */
+			ivi_layout_activate_by_surf(ivi_output, previous_active);
 		}
 	} else if (surf->role == IVI_SURFACE_ROLE_POPUP) {
 		struct weston_view *view  = surf->view;
@@ -30,29 +30,103 @@
 #include <sys/smack.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
+#include <libweston/zalloc.h>
 #include "shared/helpers.h"
 
-#ifdef HAVE_SMACK
-static const char *const bind_agl_shell[] = {
-	"User::App::homescreen",
+/*
+ * The lists can be replaced from the [policy-deny] section, with
+ * comma-separated values for 'permitted-apps', 'agl-shell-labels' and
+ * 'agl-shell-desktop-labels'; these are the defaults.
+ */
+#define DEFAULT_BIND_AGL_SHELL							\
+	"User::App::homescreen,"						\
 	"User::App::cluster-gauges"	/* cluster-dashboard */
-};
 
-static const char *const bind_agl_shell_desktop[] = {
-	"User::App::launcher",
-	"User::App::alexa-viewer",
-	"User::App::tbtnavi",
-	"User::App::hvac",
-	"User::App::xdg-cluster-receiver",		/* cluster-receiver, native XDG app*/
-	"User::App::cluster-receiver"			/* cluster-receiver, Qt app  */
+#define DEFAULT_BIND_AGL_SHELL_DESKTOP						\
+	"User::App::launcher,"							\
+	"User::App::alexa-viewer,"						\
+	"User::App::tbtnavi,"							\
+	"User::App::hvac,"							\
+	"User::App::xdg-cluster-receiver,"	/* cluster-receiver, native XDG app*/ \
+	"User::App::cluster-receiver"		/* cluster-receiver, Qt app  */
+
+#define DEFAULT_APPLICATIONS_PERMITTED						\
+	"homescreen,alexa-viewer,launcher,hvac,navigation,mediaplayer"
+
+/* sorted, looked up with bsearch() */
+struct ivi_policy_list {
+	char **items;
+	size_t count;
 };
+
+static struct ivi_policy_list applications_permitted;
+#ifdef HAVE_SMACK
+static struct ivi_policy_list bind_agl_shell;
+static struct ivi_policy_list bind_agl_shell_desktop;
 #endif
 
-static const char *const applications_permitted[] = {
-	"homescreen", "alexa-viewer", "launcher", "hvac",
-	"navigation", "mediaplayer"
-};
+static int
+ivi_policy_list_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static bool
+ivi_policy_list_has(const struct ivi_policy_list *list, const char *item)
+{
+	if (!item || list->count == 0)
+		return false;
+
+	return bsearch(&item, list->items, list->count,
+		       sizeof(list->items[0]), ivi_policy_list_cmp) != NULL;
+}
+
+static void
+ivi_policy_list_load(struct ivi_policy_list *list,
+		     struct weston_config_section *section, const char *key,
+		     const char *def)
+{
+	char *value = NULL, *item, *save = NULL;
+	size_t size = 0;
+
+	weston_config_section_get_string(section, key, &value, def);
+	if (!value)
+		return;
+
+	for (item = strtok_r(value, ", ", &save); item;
+	     item = strtok_r(NULL, ", ", &save)) {
+		if (list->count == size) {
+			char **items;
+
+			size = size ? size * 2 : 8;
+			items = realloc(list->items, size * sizeof(*items));
+			if (!items)
+				break;
+			list->items = items;
+		}
+
+		list->items[list->count] = strdup(item);
+		if (list->items[list->count])
+			list->count++;
+	}
+	free(value);
+
+	qsort(list->items, list->count, sizeof(list->items[0]),
+	      ivi_policy_list_cmp);
+}
+
+static void
+ivi_policy_list_release(struct ivi_policy_list *list)
+{
+	for (size_t i = 0; i < list->count; i++)
+		free(list->items[i]);
+	free(list->items);
+
+	list->items = NULL;
+	list->count = 0;
+}
 
 /* helper start searches the applications_permitted for the
  * app_id
@@ -60,11 +134,7 @@ static const char *const applications_permitted[] = {
 static bool
 ivi_policy_verify_permitted_app(const char *app_id)
 {
-	for (size_t i = 0; i < ARRAY_LENGTH(applications_permitted); i++)
-		if (strcmp(app_id, applications_permitted[i]) == 0)
-			return true;
-
-	return false;
+	return ivi_policy_list_has(&applications_permitted, app_id);
 }
 
 #ifdef HAVE_SMACK
@@ -74,29 +144,78 @@ ivi_policy_verify_permitted_app(const char *app_id)
 static bool
 ivi_policy_check_bind_agl_shell(const char *app_id)
 {
-	for (size_t i = 0; i < ARRAY_LENGTH(bind_agl_shell); i++)
-		if (strcmp(app_id, bind_agl_shell[i]) == 0)
-			return true;
-
-	return false;
+	return ivi_policy_list_has(&bind_agl_shell, app_id);
 }
 
 static bool
 ivi_policy_check_bind_agl_shell_desktop(const char *app_id)
 {
-	for (size_t i = 0; i < ARRAY_LENGTH(bind_agl_shell_desktop); i++)
-		if (strcmp(app_id, bind_agl_shell_desktop[i]) == 0)
-			return true;
+	return ivi_policy_list_has(&bind_agl_shell_desktop, app_id);
+}
 
-	return false;
+/* the SMACK label of a client doesn't change, so it is only retrieved on
+ * the first bind */
+struct ivi_policy_client_label {
+	char *label;
+	struct wl_listener destroy_listener;
+};
+
+static void
+ivi_policy_client_label_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_policy_client_label *client_label =
+		container_of(listener, struct ivi_policy_client_label,
+			     destroy_listener);
+
+	wl_list_remove(&client_label->destroy_listener.link);
+	free(client_label->label);
+	free(client_label);
+}
+
+static const char *
+ivi_policy_get_client_label(struct wl_client *client)
+{
+	struct ivi_policy_client_label *client_label;
+	struct wl_listener *listener;
+	char *label;
+
+	listener = wl_client_get_destroy_listener(client,
+						  ivi_policy_client_label_destroy);
+	if (listener) {
+		client_label = container_of(listener,
+					    struct ivi_policy_client_label,
+					    destroy_listener);
+		return client_label->label;
+	}
+
+	if (smack_new_label_from_socket(wl_client_get_fd(client), &label) < 0)
+		return NULL;
+
+	client_label = zalloc(sizeof(*client_label));
+	if (!client_label) {
+		free(label);
+		return NULL;
+	}
+
+	client_label->label = label;
+	client_label->destroy_listener.notify = ivi_policy_client_label_destroy;
+	wl_client_add_destroy_listener(client, &client_label->destroy_listener);
+
+	return label;
 }
 #endif
 
 static bool
 ivi_policy_verify_ivi_surface(struct ivi_surface *surf)
 {
-	const char *app_id = weston_desktop_surface_get_app_id(surf->dsurface);
-	return ivi_policy_verify_permitted_app(app_id);
+	/* surf->app_id is kept in sync with the client's */
+	if (!surf->policy_verdict.valid) {
+		surf->policy_verdict.allowed =
+			ivi_policy_verify_permitted_app(surf->app_id);
+		surf->policy_verdict.valid = true;
+	}
+
+	return surf->policy_verdict.allowed;
 }
 
 /*
@@ -153,16 +272,14 @@ ivi_policy_default_shell_bind_interface(void *client, void *interface)
 	struct wl_client *conn_client = client;
 
 	pid_t pid, uid, gid;
-	int client_fd;
-	char *label;
+	const char *label;
 	bool ret = false;
 
 	wl_client_get_credentials(conn_client, &pid, &uid, &gid);
 
-	client_fd = wl_client_get_fd(conn_client);
-	if (smack_new_label_from_socket(client_fd, &label) < 0) {
+	label = ivi_policy_get_client_label(conn_client);
+	if (!label)
 		return ret;
-	}
 
 	if (strcmp(shell_interface->name, "agl_shell") == 0)
 		ret = ivi_policy_check_bind_agl_shell(label);
@@ -175,8 +292,6 @@ ivi_policy_default_shell_bind_interface(void *client, void *interface)
 				"to bind to %s for label %s\n", pid, uid, gid,
 				shell_interface->name, label);
 
-	/* client responsible for free'ing */
-	free(label);
 	return ret;
 }
 #else
@@ -227,13 +342,48 @@ static const struct ivi_policy_api policy_api = {
 	.policy_rule_try_event = ivi_policy_default_try_event,
 };
 
+static void
+ivi_policy_deny_destroy(struct wl_listener *listener, void *data)
+{
+	wl_list_remove(&listener->link);
+	free(listener);
+
+	ivi_policy_list_release(&applications_permitted);
+#ifdef HAVE_SMACK
+	ivi_policy_list_release(&bind_agl_shell);
+	ivi_policy_list_release(&bind_agl_shell_desktop);
+#endif
+}
+
 int
 ivi_policy_init(struct ivi_compositor *ivi)
 {
+	struct weston_config_section *section;
+	struct wl_listener *destroy_listener;
+
 	ivi->policy = ivi_policy_create(ivi, &policy_api, ivi);
 	if (!ivi->policy)
 		return -1;
 
+	section = weston_config_get_section(ivi->config, "policy-deny",
+					    NULL, NULL);
+	ivi_policy_list_load(&applications_permitted, section,
+			     "permitted-apps", DEFAULT_APPLICATIONS_PERMITTED);
+#ifdef HAVE_SMACK
+	ivi_policy_list_load(&bind_agl_shell, section, "agl-shell-labels",
+			     DEFAULT_BIND_AGL_SHELL);
+	ivi_policy_list_load(&bind_agl_shell_desktop, section,
+			     "agl-shell-desktop-labels",
+			     DEFAULT_BIND_AGL_SHELL_DESKTOP);
+#endif
+
+	destroy_listener = zalloc(sizeof(*destroy_listener));
+	if (destroy_listener) {
+		destroy_listener->notify = ivi_policy_deny_destroy;
+		wl_signal_add(&ivi->compositor->destroy_signal,
+			      destroy_listener);
+	}
+
 	weston_log("Installing 'deny-all' policy engine\n");
 	return 0;
 }
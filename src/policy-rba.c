@@ -29,6 +29,254 @@
 #include "rba_adapter.h"
 
 #include <string.h>
+#include <libweston/zalloc.h>
+
+struct ivi_policy_rba {
+	struct ivi_compositor *ivi;
+
+	/* verdicts are handed out by the adapter's worker thread */
+	bool async;
+	struct wl_list activations;	/* rba_activation::link */
+	/* surface whose activation is being completed after being allowed */
+	struct ivi_surface *approved;
+
+	/* policy states double as RBA scenes, laid out in one go on outputs
+	 * with 'rba-scene-layout' set */
+	char *scene;
+	struct wl_list scenes;	/* rba_scene::link */
+	struct wl_listener state_listener;
+
+	struct wl_listener destroy_listener;
+};
+
+struct rba_scene {
+	struct ivi_policy_rba *rba;
+	struct ivi_output *output;
+	struct rba_adapter_request *req;
+	struct wl_list link;	/* ivi_policy_rba::scenes */
+};
+
+struct rba_activation {
+	struct ivi_policy_rba *rba;
+	struct ivi_output *output;
+	char *app_id;
+	struct rba_adapter_request *req;
+	struct wl_list link;	/* ivi_policy_rba::activations */
+};
+
+static void
+rba_activation_destroy(struct rba_activation *act)
+{
+	wl_list_remove(&act->link);
+	free(act->app_id);
+	free(act);
+}
+
+static void
+ivi_policy_rba_verdict(void *data, bool allowed)
+{
+	struct rba_activation *act = data;
+	struct ivi_policy_rba *rba = act->rba;
+	struct ivi_surface *surf;
+
+	wl_list_remove(&act->link);
+	wl_list_init(&act->link);
+
+	/* the surface might have gone away in the meantime */
+	surf = ivi_find_app(rba->ivi, act->app_id);
+	if (allowed && surf && act->output->output) {
+		rba->approved = surf;
+		ivi_layout_activate_by_surf(act->output, surf);
+		rba->approved = NULL;
+	}
+
+	rba_activation_destroy(act);
+}
+
+static void
+rba_scene_destroy(struct rba_scene *scene)
+{
+	wl_list_remove(&scene->link);
+	free(scene);
+}
+
+static bool
+rba_scene_has_app(const struct rba_adapter_allocation *allocs, size_t count,
+		  const char *app_id)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		if (strcmp(allocs[i].app_id, app_id) == 0)
+			return true;
+
+	return false;
+}
+
+/* surfaces parked in the warm cache are still mapped, but in the hidden
+ * layer */
+static bool
+rba_scene_surface_visible(struct ivi_compositor *ivi, struct ivi_surface *surf)
+{
+	return weston_view_is_mapped(surf->view) &&
+	       surf->view->layer_link.layer != &ivi->hidden;
+}
+
+/* places the contents of every area in a single layout transaction, and
+ * takes whatever lost its area off the output; applying the transaction
+ * updates the active surface, the MRU list and the warm cache the same way
+ * an activation would */
+static void
+ivi_policy_rba_scene(void *data, const struct rba_adapter_allocation *allocs,
+		     size_t count)
+{
+	struct rba_scene *scene = data;
+	struct ivi_compositor *ivi;
+	struct ivi_output *output;
+	struct ivi_surface *surf;
+	size_t i, placed = 0;
+
+	/* a deactivation */
+	if (!scene)
+		return;
+
+	ivi = scene->rba->ivi;
+	output = scene->output;
+	if (!output->output)
+		goto out;
+
+	wl_list_for_each(surf, &ivi->surfaces, link) {
+		if (surf->role != IVI_SURFACE_ROLE_DESKTOP || !surf->app_id ||
+		    ivi_layout_get_output_from_surface(surf) != output ||
+		    !rba_scene_surface_visible(ivi, surf))
+			continue;
+
+		if (!rba_scene_has_app(allocs, count, surf->app_id))
+			ivi_layout_set_unmapped(surf);
+	}
+
+	for (i = 0; i < count; i++) {
+		surf = ivi_find_app(ivi, allocs[i].app_id);
+		if (!surf || surf->role != IVI_SURFACE_ROLE_DESKTOP)
+			continue;
+
+		surf->desktop.last_output = output;
+		ivi_layout_set_position(surf,
+					output->output->x + allocs[i].x,
+					output->output->y + allocs[i].y,
+					allocs[i].width, allocs[i].height);
+		if (!rba_scene_surface_visible(ivi, surf))
+			ivi_layout_set_mapped(surf);
+		placed++;
+	}
+
+	ivi_layout_commit(ivi);
+	weston_log("RBA scene laid out on output %s, %zu of %zu area(s) "
+		   "placed\n", output->name, placed, count);
+
+out:
+	/* called straight away, without a request, when synchronous */
+	if (scene->req)
+		rba_scene_destroy(scene);
+}
+
+static void
+ivi_policy_rba_request_scene(struct ivi_policy_rba *rba,
+			     struct ivi_output *output, const char *name,
+			     bool active)
+{
+	struct rba_scene *scene = NULL, *tmp, *next;
+	struct rba_adapter_request *req;
+
+	/* only activations get laid out */
+	if (active) {
+		scene = zalloc(sizeof(*scene));
+		if (!scene)
+			return;
+
+		scene->rba = rba;
+		scene->output = output;
+		wl_list_init(&scene->link);
+	}
+
+	if (!rba->async || !rba_adapter_is_async(output)) {
+		rba_adapter_set_scene(output, name, active, scene);
+		free(scene);
+		return;
+	}
+
+	/* the arbitrator goes through every scene change, but only the last
+	 * one on an output is laid out */
+	if (scene) {
+		wl_list_for_each_safe(tmp, next, &rba->scenes, link) {
+			if (tmp->output != output)
+				continue;
+
+			rba_adapter_cancel(tmp->req);
+			rba_scene_destroy(tmp);
+		}
+	}
+
+	req = rba_adapter_set_scene_async(output, name, active, scene);
+	if (!req) {
+		weston_log("Unable to queue RBA scene %s for output %s\n",
+			   name, output->name);
+		free(scene);
+		return;
+	}
+
+	if (scene) {
+		scene->req = req;
+		wl_list_insert(rba->scenes.prev, &scene->link);
+	}
+}
+
+static const char *
+ivi_policy_rba_state_name(struct ivi_policy *policy, uint32_t state)
+{
+	struct state_event *st;
+
+	wl_list_for_each(st, &policy->states, link)
+		if (st->value == state)
+			return st->name;
+
+	return NULL;
+}
+
+static void
+ivi_policy_rba_state_changed(struct wl_listener *listener, void *data)
+{
+	struct ivi_policy_rba *rba =
+		wl_container_of(listener, rba, state_listener);
+	struct ivi_policy *policy = data;
+	struct ivi_output *output;
+	const char *name;
+
+	name = ivi_policy_rba_state_name(policy, policy->current_state);
+	if (!name)
+		return;
+
+	wl_list_for_each(output, &rba->ivi->outputs, link) {
+		bool scene_layout;
+
+		if (!output->output || !output->config)
+			continue;
+
+		weston_config_section_get_bool(output->config,
+					       "rba-scene-layout",
+					       &scene_layout, false);
+		if (!scene_layout)
+			continue;
+
+		if (rba->scene)
+			ivi_policy_rba_request_scene(rba, output, rba->scene,
+						     false);
+		ivi_policy_rba_request_scene(rba, output, name, true);
+	}
+
+	free(rba->scene);
+	rba->scene = strdup(name);
+}
 
 static bool
 ivi_policy_rba_surface_create(struct ivi_surface *surf, void *user_data)
@@ -45,13 +293,56 @@ ivi_policy_rba_surface_commmited(struct ivi_surface *surf, void *user_data)
 static bool
 ivi_policy_rba_surface_activate(struct ivi_surface *surf, void *user_data)
 {
+	struct ivi_policy_rba *rba = surf->ivi->policy->user_data;
+	struct rba_activation *act, *tmp;
+	struct ivi_output *output = surf->activate_output;
 	const char *app_id = NULL;
+
+	/* coming back from ivi_policy_rba_verdict() */
+	if (surf == rba->approved)
+		return true;
+
 	app_id = weston_desktop_surface_get_app_id(surf->dsurface);
 	if (app_id == NULL) {
 		weston_log("app_id is NULL, surface activation failed.\n");
 		return false;
 	}
-	return rba_adapter_arbitrate(app_id,surf->ivi);
+
+	/* the worker of the output's model might have failed to start */
+	if (!rba->async || !rba_adapter_is_async(output))
+		return rba_adapter_arbitrate(output, app_id);
+
+	/* a newer activation supersedes the ones still waiting on the same
+	 * output, such that they complete in the order they were made */
+	wl_list_for_each_safe(act, tmp, &rba->activations, link) {
+		if (act->output != output)
+			continue;
+
+		rba_adapter_cancel(act->req);
+		rba_activation_destroy(act);
+	}
+
+	act = zalloc(sizeof(*act));
+	if (!act)
+		return false;
+
+	act->rba = rba;
+	act->output = output;
+	act->app_id = strdup(app_id);
+	act->req = rba_adapter_arbitrate_async(output, app_id, act);
+	if (!act->app_id || !act->req) {
+		weston_log("Unable to queue arbitration for app_id %s, "
+			   "surface activation failed.\n", app_id);
+		if (act->req)
+			rba_adapter_cancel(act->req);
+		free(act->app_id);
+		free(act);
+		return false;
+	}
+	wl_list_insert(rba->activations.prev, &act->link);
+
+	/* ivi_policy_rba_verdict() does the activation, if allowed */
+	return false;
 }
 
 static bool
@@ -75,7 +366,7 @@ ivi_policy_rba_surface_advertise_state_change(struct ivi_surface *surf, void *us
 static bool
 ivi_policy_rba_shell_bind_interface(void *client, void *interface)
 {
-	return rba_adapter_initialize();
+	return rba_adapter_ensure_model();
 }
 
 static const struct ivi_policy_api policy_api = {
@@ -91,12 +382,67 @@ static const struct ivi_policy_api policy_api = {
 	.policy_rule_try_event = NULL,
 };
 
+static void
+ivi_policy_rba_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_policy_rba *rba =
+		wl_container_of(listener, rba, destroy_listener);
+	struct rba_activation *act, *tmp;
+	struct rba_scene *scene, *scene_tmp;
+
+	wl_list_remove(&rba->destroy_listener.link);
+	wl_list_remove(&rba->state_listener.link);
+
+	rba_adapter_stop();
+	rba_adapter_unwatch();
+	wl_list_for_each_safe(act, tmp, &rba->activations, link)
+		rba_activation_destroy(act);
+	wl_list_for_each_safe(scene, scene_tmp, &rba->scenes, link)
+		rba_scene_destroy(scene);
+	free(rba->scene);
+
+	rba->ivi->policy->user_data = NULL;
+	free(rba);
+}
+
 int
 ivi_policy_init(struct ivi_compositor *ivi)
 {
-	ivi->policy = ivi_policy_create(ivi, &policy_api, ivi);
-	if (!ivi->policy)
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(ivi->compositor->wl_display);
+	struct ivi_policy_rba *rba;
+
+	rba = zalloc(sizeof(*rba));
+	if (!rba)
+		return -1;
+
+	ivi->policy = ivi_policy_create(ivi, &policy_api, rba);
+	if (!ivi->policy) {
+		free(rba);
 		return -1;
+	}
+
+	rba->ivi = ivi;
+	wl_list_init(&rba->activations);
+	wl_list_init(&rba->scenes);
+	rba->state_listener.notify = ivi_policy_rba_state_changed;
+	wl_signal_add(&ivi->policy->signal_state_change, &rba->state_listener);
+	rba->destroy_listener.notify = ivi_policy_rba_destroy;
+	wl_signal_add(&ivi->compositor->destroy_signal, &rba->destroy_listener);
+
+	rba_adapter_configure(ivi);
+
+	rba->async = rba_adapter_start(loop, ivi_policy_rba_verdict,
+				       ivi_policy_rba_scene);
+	if (!rba->async)
+		weston_log("RBA arbitration will run on the main thread\n");
+
+	/* rather than on the first bind, which would hold up the shell
+	 * client on parsing the model */
+	if (!rba->async || !rba_adapter_initialize_async())
+		rba_adapter_initialize();
+
+	rba_adapter_watch(loop);
 
 	weston_log("Installing 'rba(Rule Base Arbitration)' policy engine\n");
 	return 0;
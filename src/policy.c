@@ -24,6 +24,7 @@
  */
 
 #include <string.h>
+#include <time.h>
 #include <libweston/zalloc.h>
 #include <assert.h>
 
@@ -61,6 +62,19 @@ ivi_policy_state_event_create(uint32_t val, const char *value)
 	return ev_st;
 }
 
+static void
+ivi_policy_mark_state_known(struct ivi_policy *policy, uint32_t state)
+{
+	if (state < IVI_POLICY_KNOWN_STATES_MAX)
+		policy->known_states[state / 32] |= 1u << (state % 32);
+}
+
+static struct wl_list *
+ivi_policy_state_bucket(struct ivi_policy *policy, uint32_t state)
+{
+	return &policy->rules_by_state[state & (IVI_POLICY_STATE_BUCKETS - 1)];
+}
+
 void
 ivi_policy_add_state(struct ivi_policy *policy, uint32_t state, const char *value)
 {
@@ -70,6 +84,7 @@ ivi_policy_add_state(struct ivi_policy *policy, uint32_t state, const char *valu
 
 	ev_st = ivi_policy_state_event_create(state, value);
 	wl_list_insert(&policy->states, &ev_st->link);
+	ivi_policy_mark_state_known(policy, state);
 }
 
 void
@@ -94,6 +109,7 @@ ivi_policy_add_default_states(struct ivi_policy *policy)
 		struct state_event *ev_st =
 			ivi_policy_state_event_create(i, default_states[i]);
 		wl_list_insert(&policy->states, &ev_st->link);
+		ivi_policy_mark_state_known(policy, i);
 	}
 }
 
@@ -120,11 +136,101 @@ ivi_policy_try_event(struct ivi_a_policy *a_policy)
 	    return policy->api.policy_rule_try_event(a_policy);
 }
 
+static uint64_t
+ivi_policy_now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* re-arms the timer for the earliest deadline, if any */
+static void
+ivi_policy_arm_timer(struct ivi_policy *policy)
+{
+	struct ivi_policy_deadline *deadline, *tmp;
+	uint64_t now;
+
+	/* cancelled rules leave empty deadlines behind */
+	wl_list_for_each_safe(deadline, tmp, &policy->deadlines, link) {
+		if (!wl_list_empty(&deadline->rules))
+			break;
+
+		wl_list_remove(&deadline->link);
+		free(deadline);
+	}
+
+	if (!policy->timer)
+		return;
+
+	if (wl_list_empty(&policy->deadlines)) {
+		wl_event_source_timer_update(policy->timer, 0);
+		return;
+	}
+
+	deadline = wl_container_of(policy->deadlines.next, deadline, link);
+	now = ivi_policy_now_msec();
+
+	/* a 0 delay would disarm the timer */
+	wl_event_source_timer_update(policy->timer,
+				     deadline->msec > now ?
+				     deadline->msec - now : 1);
+}
+
+static void
+ivi_policy_cancel_timeout(struct ivi_a_policy *a_policy)
+{
+	if (!a_policy->deadline)
+		return;
+
+	wl_list_remove(&a_policy->timeout_link);
+	wl_list_init(&a_policy->timeout_link);
+	a_policy->deadline = NULL;
+	a_policy->policy->pending_timeouts--;
+}
+
+static void
+ivi_policy_cancel_timeouts(struct ivi_policy *policy)
+{
+	struct ivi_policy_deadline *deadline;
+	struct ivi_a_policy *a_policy, *tmp;
+
+	wl_list_for_each(deadline, &policy->deadlines, link)
+		wl_list_for_each_safe(a_policy, tmp, &deadline->rules,
+				      timeout_link)
+			ivi_policy_cancel_timeout(a_policy);
+}
+
 static int
 ivi_policy_try_event_timeout(void *user_data)
 {
-	struct ivi_a_policy *a_policy = user_data;
-	ivi_policy_try_event(a_policy);
+	struct ivi_policy *policy = user_data;
+	uint64_t now = ivi_policy_now_msec();
+
+	while (!wl_list_empty(&policy->deadlines)) {
+		struct ivi_policy_deadline *deadline =
+			wl_container_of(policy->deadlines.next, deadline, link);
+
+		if (deadline->msec > now)
+			break;
+
+		/* the hooks might add or cancel timeouts, so take the rules
+		 * out one at a time */
+		wl_list_remove(&deadline->link);
+		while (!wl_list_empty(&deadline->rules)) {
+			struct ivi_a_policy *a_policy =
+				wl_container_of(deadline->rules.next,
+						a_policy, timeout_link);
+
+			ivi_policy_cancel_timeout(a_policy);
+			if (a_policy->state == policy->current_state)
+				ivi_policy_try_event(a_policy);
+		}
+		free(deadline);
+	}
+
+	ivi_policy_arm_timer(policy);
 	return 0;
 }
 
@@ -133,14 +239,50 @@ ivi_policy_setup_event_timeout(struct ivi_policy *ivi_policy,
 			       struct ivi_a_policy *a_policy)
 {
 	struct ivi_compositor *ivi = ivi_policy->ivi;
-	struct wl_display *wl_display = ivi->compositor->wl_display;
-	struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
+	struct ivi_policy_deadline *deadline;
+	struct wl_list *prev = &ivi_policy->deadlines;
+	uint64_t msec;
+
+	if (!ivi_policy->timer) {
+		struct wl_display *wl_display = ivi->compositor->wl_display;
+		struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
+
+		ivi_policy->timer =
+			wl_event_loop_add_timer(loop,
+						ivi_policy_try_event_timeout,
+						ivi_policy);
+		if (!ivi_policy->timer)
+			return;
+	}
 
-	a_policy->timer = wl_event_loop_add_timer(loop,
-						  ivi_policy_try_event_timeout,
-						  a_policy);
+	ivi_policy_cancel_timeout(a_policy);
+	msec = ivi_policy_now_msec() + a_policy->timeout;
 
-	wl_event_source_timer_update(a_policy->timer, a_policy->timeout);
+	/* new deadlines usually land at the end, so look from there */
+	wl_list_for_each_reverse(deadline, &ivi_policy->deadlines, link) {
+		if (deadline->msec == msec)
+			goto add_rule;
+
+		if (deadline->msec < msec) {
+			prev = &deadline->link;
+			break;
+		}
+	}
+
+	deadline = zalloc(sizeof(*deadline));
+	if (!deadline)
+		return;
+
+	deadline->msec = msec;
+	wl_list_init(&deadline->rules);
+	wl_list_insert(prev, &deadline->link);
+
+add_rule:
+	wl_list_insert(deadline->rules.prev, &a_policy->timeout_link);
+	a_policy->deadline = deadline;
+	ivi_policy->pending_timeouts++;
+
+	ivi_policy_arm_timer(ivi_policy);
 }
 
 static void
@@ -149,9 +291,22 @@ ivi_policy_check_policies(struct wl_listener *listener, void *data)
 	struct ivi_a_policy *a_policy;
 	struct ivi_policy *ivi_policy =
 		wl_container_of(listener, ivi_policy, listener_check_policies);
+	struct wl_list *bucket =
+		ivi_policy_state_bucket(ivi_policy, ivi_policy->current_state);
 
 	ivi_policy->state_change_in_progress = true;
-	wl_list_for_each(a_policy, &ivi_policy->policies, link) {
+
+	/* whatever was pending for the previous state is now stale */
+	if (ivi_policy->pending_timeouts > 0) {
+		weston_log_scope_printf(ivi_policy->ivi->policy_scope,
+					"Policy state changed, cancelling %u "
+					"pending timeout(s)\n",
+					ivi_policy->pending_timeouts);
+		ivi_policy_cancel_timeouts(ivi_policy);
+		ivi_policy_arm_timer(ivi_policy);
+	}
+
+	wl_list_for_each(a_policy, bucket, state_link) {
 		if (ivi_policy->current_state == a_policy->state) {
 			/* check the timeout first to see if there's a timeout */
 			if (a_policy->timeout > 0)
@@ -194,6 +349,9 @@ ivi_policy_create(struct ivi_compositor *ivi,
 
 	/* policy rules */
 	wl_list_init(&policy->policies);
+	wl_list_init(&policy->deadlines);
+	for (size_t i = 0; i < ARRAY_LENGTH(policy->rules_by_state); i++)
+		wl_list_init(&policy->rules_by_state[i]);
 
 	wl_list_init(&policy->events);
 	wl_list_init(&policy->states);
@@ -213,10 +371,16 @@ ivi_policy_destroy(struct ivi_policy *ivi_policy)
 	if (!ivi_policy)
 		return;
 
+	ivi_policy_cancel_timeouts(ivi_policy);
+	ivi_policy_arm_timer(ivi_policy);
+	if (ivi_policy->timer)
+		wl_event_source_remove(ivi_policy->timer);
+
 	wl_list_for_each_safe(a_policy, a_policy_tmp,
 			      &ivi_policy->policies, link) {
 		free(a_policy->app_id);
 		wl_list_remove(&a_policy->link);
+		wl_list_remove(&a_policy->state_link);
 		free(a_policy);
 	}
 
@@ -233,6 +397,9 @@ ivi_policy_state_is_known(uint32_t state, struct ivi_policy *policy)
 {
 	struct state_event *ev_st;
 
+	if (state < IVI_POLICY_KNOWN_STATES_MAX)
+		return policy->known_states[state / 32] & (1u << (state % 32));
+
 	wl_list_for_each(ev_st, &policy->states, link) {
 		if (ev_st->value == state) {
 			return true;
@@ -295,8 +462,11 @@ ivi_policy_add(struct ivi_policy *policy, const char *app_id, uint32_t state,
 	a_policy->timeout = timeout;
 	a_policy->output = output;
 	a_policy->policy = policy;
+	wl_list_init(&a_policy->timeout_link);
 
 	wl_list_insert(&policy->policies, &a_policy->link);
+	wl_list_insert(ivi_policy_state_bucket(policy, state),
+		       &a_policy->state_link);
 
 	return 0;
 }
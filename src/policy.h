@@ -43,6 +43,13 @@
 #define AGL_SHELL_POLICY_EVENT_HIDE 1
 #endif
 
+/* rules are bucketed by state, must be a power of two */
+#define IVI_POLICY_STATE_BUCKETS 64
+
+/* states below this value are looked up in a bitset rather than in
+ * ivi_policy::states */
+#define IVI_POLICY_KNOWN_STATES_MAX 256
+
 struct ivi_policy;
 
 struct state_event {
@@ -51,6 +58,13 @@ struct state_event {
 	struct wl_list link;	/* ivi_policy::states or ivi_policy::events */
 };
 
+/* rules due at the same millisecond share a deadline */
+struct ivi_policy_deadline {
+	uint64_t msec;
+	struct wl_list rules;	/* ivi_a_policy::timeout_link */
+	struct wl_list link;	/* ivi_policy::deadlines */
+};
+
 struct ivi_a_policy {
 	struct ivi_policy *policy;
 
@@ -59,9 +73,13 @@ struct ivi_a_policy {
 	uint32_t event;
 	uint32_t timeout;
 	struct ivi_output *output;
-	struct wl_event_source *timer;	/* for policies that have a timeout */
+
+	/* for policies that have a timeout, set while it is pending */
+	struct ivi_policy_deadline *deadline;
+	struct wl_list timeout_link;	/* ivi_policy_deadline::rules */
 
 	struct wl_list link;	/* ivi_policy::ivi_policies */
+	struct wl_list state_link;	/* ivi_policy::rules_by_state */
 };
 
 struct ivi_policy_api {
@@ -93,6 +111,9 @@ struct ivi_policy {
 
 	/* represents the policy rules */
 	struct wl_list policies;	/* ivi_a_policy::link */
+	/* the same rules, by state, such that a state change only goes
+	 * over the rules which could apply */
+	struct wl_list rules_by_state[IVI_POLICY_STATE_BUCKETS]; /* ivi_a_policy::state_link */
 
 	/* no state update chnage is being done as long as we have the same
 	 * state */
@@ -102,10 +123,17 @@ struct ivi_policy {
 	/* guards against current in change in progress */
 	bool state_change_in_progress;
 
+	/* pending rule timeouts, sorted by deadline, all served by a single
+	 * timer armed for the earliest one */
+	struct wl_list deadlines;	/* ivi_policy_deadline::link */
+	struct wl_event_source *timer;
+	uint32_t pending_timeouts;
+
 	/* additional states which can be verified in
 	 * ivi_policy_api::policy_rule_try_event() */
 	struct wl_list states;	/* state_event::link */
 	struct wl_list events;	/* state_event::link */
+	uint32_t known_states[IVI_POLICY_KNOWN_STATES_MAX / 32];
 
 	/* necessary to for signaling the state change */
 	struct wl_listener listener_check_policies;
@@ -25,71 +25,1075 @@
 
 #include <string>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstdarg>
+#include <cstring>
 #include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 
 #include "rba_adapter.h"
 #include "ivi-compositor.h"
 #include <libweston/config-parser.h>
 #include <libweston/libweston.h>
+#include <wayland-server-core.h>
 
 #include "RBAJsonParser.hpp"
 #include "RBAArbitrator.hpp"
 using namespace std;
 
 #define JSONFILE "/etc/rba/RBAModel.json"
-rba::RBAJsonParser parser;
-rba::RBAModel* model = nullptr;
-rba::RBAArbitrator* arb = nullptr;
-unique_ptr<rba::RBAResult> result = nullptr;
 
-bool rba_adapter_initialize(void)
+/* a partition's requests go through a ring of this size */
+#define RBA_ADAPTER_QUEUE_SIZE 64
+
+static bool allow_unregistred_app = false;
+
+/* weston_log() isn't meant to be called from other threads, so the worker
+ * collects its messages here and the event loop prints them */
+static thread_local string *deferred_log = nullptr;
+
+static void
+rba_adapter_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	if (deferred_log) {
+		char buf[512];
+
+		vsnprintf(buf, sizeof(buf), fmt, ap);
+		*deferred_log += buf;
+	} else {
+		weston_vlog(fmt, ap);
+	}
+	va_end(ap);
+}
+
+static long
+rba_adapter_elapsed_ms(chrono::steady_clock::time_point start)
 {
-	if (arb == nullptr) {
-		if (access(JSONFILE, F_OK) == -1) {
-			weston_log("Unable to find %s file!!\n", JSONFILE);
+	return chrono::duration_cast<chrono::milliseconds>(
+			chrono::steady_clock::now() - start).count();
+}
+
+enum rba_adapter_request_type {
+	RBA_ADAPTER_REQUEST_ARBITRATE,
+	/* builds the arbitrator, result in allowed */
+	RBA_ADAPTER_REQUEST_LOAD,
+	/* installs model/arb, see rba_partition_swap() */
+	RBA_ADAPTER_REQUEST_SWAP,
+	/* (de)activates the scene in app_id, see rba_partition_set_scene() */
+	RBA_ADAPTER_REQUEST_SCENE,
+};
+
+struct rba_adapter_area {
+	string app_id;
+	int32_t x, y;
+	int32_t width, height;
+};
+
+enum rba_adapter_model_state {
+	RBA_ADAPTER_MODEL_NONE,
+	RBA_ADAPTER_MODEL_LOADING,
+	RBA_ADAPTER_MODEL_READY,
+	RBA_ADAPTER_MODEL_FAILED,
+};
+
+struct rba_adapter_request {
+	enum rba_adapter_request_type type;
+	string app_id;
+	string log;
+	void *data;
+	rba::RBAModel *model;
+	rba::RBAArbitrator *arb;
+	/* scene requests only */
+	bool active;
+	vector<struct rba_adapter_area> areas;
+	atomic<bool> cancelled;
+	bool allowed;
+};
+
+class rba_adapter_ring {
+public:
+	bool push(struct rba_adapter_request *req)
+	{
+		size_t tail = m_tail.load(memory_order_relaxed);
+
+		if (tail - m_head.load(memory_order_acquire) == RBA_ADAPTER_QUEUE_SIZE)
+			return false;
+
+		m_slots[tail % RBA_ADAPTER_QUEUE_SIZE] = req;
+		m_tail.store(tail + 1, memory_order_release);
+		return true;
+	}
+
+	struct rba_adapter_request *pop(void)
+	{
+		size_t head = m_head.load(memory_order_relaxed);
+		struct rba_adapter_request *req;
+
+		if (head == m_tail.load(memory_order_acquire))
+			return nullptr;
+
+		req = m_slots[head % RBA_ADAPTER_QUEUE_SIZE];
+		m_head.store(head + 1, memory_order_release);
+		return req;
+	}
+
+private:
+	struct rba_adapter_request *m_slots[RBA_ADAPTER_QUEUE_SIZE];
+	atomic<size_t> m_head{0};
+	atomic<size_t> m_tail{0};
+};
+
+/*
+ * A model file, with its own arbitrator. Outputs pick theirs with the
+ * 'rba-model' key of their [output] section and share the default one,
+ * JSONFILE, otherwise.
+ *
+ * Each partition has its own worker thread, which is the only one to touch
+ * the arbitrator once it runs: requests are handed to it through a
+ * single-producer/single-consumer ring, and the verdicts come back through
+ * another one, with an eventfd waking up the compositor's event loop. This
+ * way, displays which don't share a model are arbitrated concurrently.
+ *
+ * Changes to the model file are picked up with inotify, and a new
+ * model/arbitrator pair is built on a separate thread, such that
+ * arbitration carries on with the old one meanwhile. The new pair is then
+ * swapped in between two arbitrations.
+ */
+struct rba_partition {
+	string path;
+
+	rba::RBAModel *model = nullptr;
+	rba::RBAArbitrator *arb = nullptr;
+	unique_ptr<rba::RBAResult> result;
+
+	/*
+	 * Verdicts of requests that left the arbitrator in the same state it
+	 * was in, valid for as long as the active scenes and content states
+	 * stay the same. Replaying those against the engine gives the same
+	 * answer and changes nothing, so we skip them altogether.
+	 */
+	string signature;
+	unordered_map<string, bool> decisions;
+
+	thread worker;
+	atomic<bool> stop{false};
+	bool running = false;
+
+	rba_adapter_ring requests;
+	rba_adapter_ring verdicts;
+	/* submitted and not yet dispatched, bounds both rings */
+	size_t in_flight = 0;
+
+	int request_fd = -1;
+	int verdict_fd = -1;
+	struct wl_event_source *verdict_source = nullptr;
+
+	/* as seen from the event loop */
+	enum rba_adapter_model_state model_state = RBA_ADAPTER_MODEL_NONE;
+
+	/* hot reload */
+	int watch = -1;
+	thread builder;
+	bool building = false;
+	/* the model changed again while building or waiting to be applied */
+	bool again = false;
+	int done_fd = -1;
+	struct wl_event_source *done_source = nullptr;
+	/* written by the builder, read once it is done */
+	string reload_log;
+	rba::RBAModel *new_model = nullptr;
+	rba::RBAArbitrator *new_arb = nullptr;
+};
+
+static struct {
+	struct ivi_compositor *ivi = nullptr;
+	struct wl_event_loop *loop = nullptr;
+	rba_adapter_verdict_func_t verdict = nullptr;
+	rba_adapter_scene_func_t scene = nullptr;
+	/* arbitration runs on the partitions' worker threads */
+	bool threaded = false;
+
+	list<unique_ptr<struct rba_partition>> partitions;
+	struct rba_partition *fallback = nullptr;
+	unordered_map<const struct ivi_output *, struct rba_partition *> by_output;
+
+	bool watching = false;
+	int inotify_fd = -1;
+	struct wl_event_source *inotify_source = nullptr;
+} adapter;
+
+static void
+rba_adapter_kick(int fd)
+{
+	uint64_t one = 1;
+
+	while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR)
+		;
+}
+
+static string
+rba_adapter_signature(const rba::RBAResult *res)
+{
+	string sig;
+
+	for (const rba::RBAScene *scene : res->getActiveScenes()) {
+		sig += scene->getName();
+		sig += ';';
+	}
+	sig += '|';
+	for (const rba::RBAViewContentState *state :
+	     res->getActiveViewContentStates()) {
+		sig += state->getUniqueName();
+		sig += ';';
+	}
+
+	return sig;
+}
+
+/* returns true if the arbitrator state didn't change with this result */
+static bool
+rba_partition_update_signature(struct rba_partition *part)
+{
+	string sig = rba_adapter_signature(part->result.get());
+
+	if (sig == part->signature)
+		return true;
+
+	part->signature = std::move(sig);
+	part->decisions.clear();
+	return false;
+}
+
+void rba_adapter_configure(struct ivi_compositor *ivi)
+{
+	struct weston_config_section *section;
+
+	adapter.ivi = ivi;
+
+	section = weston_config_get_section(ivi->config, "core", NULL, NULL);
+	weston_config_section_get_bool(section, "allow_unregistred_app",
+				       &allow_unregistred_app, false);
+}
+
+static bool
+rba_partition_initialize(struct rba_partition *part)
+{
+	if (part->arb == nullptr) {
+		const char *path = part->path.c_str();
+		rba::RBAJsonParser parser;
+		chrono::steady_clock::time_point start;
+
+		if (access(path, F_OK) == -1) {
+			rba_adapter_log("Unable to find %s file!!\n", path);
 			return false;
 		}
-		model = parser.parse(JSONFILE);
-		if (model == nullptr) {
-			weston_log("RBAmodel is NULL\n");
+
+		start = chrono::steady_clock::now();
+		part->model = parser.parse(path);
+		if (part->model == nullptr) {
+			rba_adapter_log("RBAmodel is NULL\n");
 			return false;
 		}
-		arb = new rba::RBAArbitrator(model);
-		if (arb == nullptr) {
-			weston_log("RBAArbitrator is NULL\n");
+		rba_adapter_log("RBA model %s parsed in %ld ms\n", path,
+				rba_adapter_elapsed_ms(start));
+
+		start = chrono::steady_clock::now();
+		part->arb = new rba::RBAArbitrator(part->model);
+		if (part->arb == nullptr) {
+			rba_adapter_log("RBAArbitrator is NULL\n");
 			return false;
 		}
+		rba_adapter_log("RBAArbitrator for %s created in %ld ms\n",
+				path, rba_adapter_elapsed_ms(start));
+
+		part->signature.clear();
+		part->decisions.clear();
 		return true;
 	}
-	weston_log("RBAArbitrator model is already created\n");
+	rba_adapter_log("RBAArbitrator model is already created\n");
 	return true;
 }
 
-bool rba_adapter_arbitrate(const char *app_id, struct ivi_compositor *ivi)
+static bool
+rba_partition_execute(struct rba_partition *part, const string &request,
+		      const char *app_id)
 {
-	bool allow_unregistred_app;
-	struct weston_config_section *section;
-	string id(app_id);
+	part->result = part->arb->execute(request, true);
 
-	result = arb->execute(id+ "/NORMAL", true);
-	section = weston_config_get_section(ivi->config, "core", NULL, NULL);
-	weston_config_section_get_bool(section, "allow_unregistred_app",
-				       &allow_unregistred_app, false);
-
-	if (result->getStatusType() == rba::RBAResultStatusType::UNKNOWN_CONTENT_STATE) {
-		weston_log("ERROR: Unknown context app: %s\n", app_id);
+	if (part->result->getStatusType() == rba::RBAResultStatusType::UNKNOWN_CONTENT_STATE) {
+		rba_adapter_log("ERROR: Unknown context app: %s\n", app_id);
 		if(allow_unregistred_app) {
-			result = arb->execute("unknown_app/NORMAL", true);
-			weston_log("!!! WARNING !!! Allowed unknown application to open as allow_unregistred_app is set to 1 in config file.\n");
-			weston_log("!!! WARNING !!! allow_unregistred_app should be disabled for release build.\n");
+			part->result = part->arb->execute("unknown_app/NORMAL", true);
+			rba_adapter_log("!!! WARNING !!! Allowed unknown application to open as allow_unregistred_app is set to 1 in config file.\n");
+			rba_adapter_log("!!! WARNING !!! allow_unregistred_app should be disabled for release build.\n");
 		} else {
 			return false;
 		}
 	}
-	if (result->getStatusType() == rba::RBAResultStatusType::FAILED ||
-	    result->getStatusType() == rba::RBAResultStatusType::CANCEL_ERROR) {
-		weston_log("ERROR: execution failed or cancel for app: %s\n", app_id);
+	if (part->result->getStatusType() == rba::RBAResultStatusType::FAILED ||
+	    part->result->getStatusType() == rba::RBAResultStatusType::CANCEL_ERROR) {
+		rba_adapter_log("ERROR: execution failed or cancel for app: %s\n", app_id);
+		return false;
+	}
+	return true;
+}
+
+/* installs a freshly built arbitrator, replaying the contents active on
+ * the previous one; called from wherever the arbitrator is used from */
+static void
+rba_partition_swap(struct rba_partition *part, rba::RBAModel *new_model,
+		   rba::RBAArbitrator *new_arb)
+{
+	list<string> active;
+	size_t replayed = 0;
+
+	/* names only, the old model goes away */
+	if (part->result) {
+		for (const rba::RBAViewContentState *state :
+		     part->result->getActiveViewContentStates())
+			active.push_back(state->getUniqueName());
+	}
+
+	part->result = nullptr;
+	delete part->arb;
+	delete part->model;
+	part->arb = new_arb;
+	part->model = new_model;
+
+	part->signature.clear();
+	part->decisions.clear();
+
+	for (const string &name : active) {
+		part->result = part->arb->execute(name, true);
+		if (part->result->getStatusType() != rba::RBAResultStatusType::SUCCESS) {
+			rba_adapter_log("RBA model reload: %s is no longer "
+					"allowed\n", name.c_str());
+			continue;
+		}
+		replayed++;
+	}
+	if (part->result)
+		rba_partition_update_signature(part);
+
+	rba_adapter_log("RBA model %s reloaded, %zu of %zu active content(s) "
+			"replayed\n", part->path.c_str(), replayed,
+			active.size());
+}
+
+static bool
+rba_partition_arbitrate(struct rba_partition *part, const char *app_id)
+{
+	string request(app_id);
+	bool allowed;
+
+	request += "/NORMAL";
+
+	if (part->arb == nullptr) {
+		rba_adapter_log("RBAArbitrator isn't available, denying app: %s\n",
+				app_id);
+		return false;
+	}
+
+	auto it = part->decisions.find(request);
+	if (it != part->decisions.end())
+		return it->second;
+
+	allowed = rba_partition_execute(part, request, app_id);
+	if (rba_partition_update_signature(part))
+		part->decisions.emplace(std::move(request), allowed);
+
+	return allowed;
+}
+
+/* what's visible in each area according to the last result, with content
+ * names standing for app_ids like in rba_partition_arbitrate() */
+static void
+rba_partition_get_areas(struct rba_partition *part,
+			vector<struct rba_adapter_area> &areas)
+{
+	const rba::RBAResult *res = part->result.get();
+
+	for (const rba::RBAArea *area : res->getVisibleAreas()) {
+		const rba::RBAViewContentState *state =
+			res->getContentState(area);
+		const rba::RBASize *size = res->getSize(area);
+		struct rba_adapter_area alloc;
+		string::size_type slash;
+
+		if (!state || !size)
+			continue;
+
+		/* the state goes after the content name, if there is one */
+		alloc.app_id = state->getUniqueName();
+		slash = alloc.app_id.rfind('/');
+		if (slash != string::npos)
+			alloc.app_id.erase(slash);
+		alloc.x = area->getX();
+		alloc.y = area->getY();
+		alloc.width = size->getWidth();
+		alloc.height = size->getHeight();
+		areas.push_back(std::move(alloc));
+	}
+}
+
+static bool
+rba_partition_set_scene(struct rba_partition *part, const char *scene,
+			bool active, vector<struct rba_adapter_area> &areas)
+{
+	rba::RBAResultStatusType status;
+
+	if (part->arb == nullptr) {
+		rba_adapter_log("RBAArbitrator isn't available, ignoring "
+				"scene: %s\n", scene);
+		return false;
+	}
+
+	part->result = part->arb->execute(scene, active);
+	status = part->result->getStatusType();
+	if (status != rba::RBAResultStatusType::SUCCESS) {
+		rba_adapter_log("ERROR: failed to %s scene: %s\n",
+				active ? "activate" : "deactivate", scene);
+		return false;
+	}
+
+	rba_partition_update_signature(part);
+	rba_partition_get_areas(part, areas);
+	return true;
+}
+
+static void
+rba_partition_worker(struct rba_partition *part)
+{
+	struct rba_adapter_request *req;
+	uint64_t count;
+
+	while (!part->stop.load()) {
+		if (read(part->request_fd, &count, sizeof(count)) < 0 &&
+		    errno != EINTR)
+			break;
+
+		while ((req = part->requests.pop())) {
+			deferred_log = &req->log;
+			if (req->type == RBA_ADAPTER_REQUEST_LOAD) {
+				req->allowed = rba_partition_initialize(part);
+			} else if (req->type == RBA_ADAPTER_REQUEST_SWAP) {
+				rba_partition_swap(part, req->model, req->arb);
+				req->model = nullptr;
+				req->arb = nullptr;
+				req->allowed = true;
+			} else if (req->type == RBA_ADAPTER_REQUEST_SCENE) {
+				/* even if superseded, such that the
+				 * arbitrator sees every scene change */
+				req->allowed =
+					rba_partition_set_scene(part,
+								req->app_id.c_str(),
+								req->active,
+								req->areas);
+			/* superseded while it was queued, no need to ask */
+			} else if (!req->cancelled.load(memory_order_relaxed)) {
+				req->allowed =
+					rba_partition_arbitrate(part,
+								req->app_id.c_str());
+			}
+			deferred_log = nullptr;
+
+			part->verdicts.push(req);
+			rba_adapter_kick(part->verdict_fd);
+		}
+	}
+}
+
+static void
+rba_partition_reload_apply(struct rba_partition *part);
+
+static void
+rba_adapter_scene_done(void *data, const vector<struct rba_adapter_area> &areas)
+{
+	vector<struct rba_adapter_allocation> allocs;
+
+	allocs.reserve(areas.size());
+	for (const struct rba_adapter_area &area : areas)
+		allocs.push_back({ area.app_id.c_str(), area.x, area.y,
+				   area.width, area.height });
+
+	adapter.scene(data, allocs.data(), allocs.size());
+}
+
+static int
+rba_partition_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct rba_partition *part = static_cast<struct rba_partition *>(data);
+	struct rba_adapter_request *req;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		weston_log("Failed to read RBA verdicts: %s\n", strerror(errno));
+
+	while ((req = part->verdicts.pop())) {
+		part->in_flight--;
+		if (!req->log.empty())
+			weston_log("%s", req->log.c_str());
+
+		if (req->type == RBA_ADAPTER_REQUEST_LOAD ||
+		    req->type == RBA_ADAPTER_REQUEST_SWAP)
+			part->model_state = req->allowed ?
+				RBA_ADAPTER_MODEL_READY :
+				RBA_ADAPTER_MODEL_FAILED;
+		else if (req->cancelled.load(memory_order_relaxed))
+			;
+		else if (req->type == RBA_ADAPTER_REQUEST_SCENE)
+			rba_adapter_scene_done(req->data, req->areas);
+		else
+			adapter.verdict(req->data, req->allowed);
+		delete req;
+	}
+
+	/* might have been waiting on a free slot */
+	rba_partition_reload_apply(part);
+
+	return 0;
+}
+
+static void
+rba_partition_stop(struct rba_partition *part)
+{
+	struct rba_adapter_request *req;
+
+	if (!part->running)
+		return;
+
+	part->stop.store(true);
+	rba_adapter_kick(part->request_fd);
+	part->worker.join();
+	part->running = false;
+
+	/* whatever is left never gets a verdict */
+	while ((req = part->requests.pop())) {
+		delete req->arb;
+		delete req->model;
+		delete req;
+	}
+	while ((req = part->verdicts.pop()))
+		delete req;
+	part->in_flight = 0;
+
+	wl_event_source_remove(part->verdict_source);
+	part->verdict_source = nullptr;
+	close(part->request_fd);
+	close(part->verdict_fd);
+	part->request_fd = part->verdict_fd = -1;
+}
+
+static bool
+rba_partition_start(struct rba_partition *part)
+{
+	part->request_fd = eventfd(0, EFD_CLOEXEC);
+	part->verdict_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (part->request_fd < 0 || part->verdict_fd < 0)
+		goto err;
+
+	part->verdict_source =
+		wl_event_loop_add_fd(adapter.loop, part->verdict_fd,
+				     WL_EVENT_READABLE, rba_partition_dispatch,
+				     part);
+	if (!part->verdict_source)
+		goto err;
+
+	part->stop.store(false);
+	try {
+		part->worker = thread(rba_partition_worker, part);
+	} catch (const system_error &e) {
+		weston_log("Failed to start the RBA worker: %s\n", e.what());
+		goto err;
+	}
+
+	part->running = true;
+	return true;
+
+err:
+	if (part->verdict_source)
+		wl_event_source_remove(part->verdict_source);
+	part->verdict_source = nullptr;
+	if (part->request_fd >= 0)
+		close(part->request_fd);
+	if (part->verdict_fd >= 0)
+		close(part->verdict_fd);
+	part->request_fd = part->verdict_fd = -1;
+	return false;
+}
+
+/* returns a request to fill in and hand to rba_partition_submit(), if
+ * there's room for it */
+static struct rba_adapter_request *
+rba_partition_request(struct rba_partition *part,
+		      enum rba_adapter_request_type type, const char *app_id,
+		      void *data)
+{
+	struct rba_adapter_request *req;
+
+	if (!part->running || part->in_flight == RBA_ADAPTER_QUEUE_SIZE)
+		return nullptr;
+
+	req = new rba_adapter_request;
+	req->type = type;
+	req->app_id = app_id ? app_id : "";
+	req->data = data;
+	req->cancelled.store(false);
+	req->allowed = false;
+	req->model = nullptr;
+	req->arb = nullptr;
+	req->active = false;
+
+	return req;
+}
+
+static void
+rba_partition_submit(struct rba_partition *part,
+		     struct rba_adapter_request *req)
+{
+	/* can't fail, in_flight bounds the ring */
+	part->requests.push(req);
+	part->in_flight++;
+	rba_adapter_kick(part->request_fd);
+}
+
+static struct rba_adapter_request *
+rba_partition_queue(struct rba_partition *part,
+		    enum rba_adapter_request_type type, const char *app_id,
+		    void *data)
+{
+	struct rba_adapter_request *req;
+
+	req = rba_partition_request(part, type, app_id, data);
+	if (req)
+		rba_partition_submit(part, req);
+
+	return req;
+}
+
+static bool
+rba_partition_load(struct rba_partition *part)
+{
+	if (part->running &&
+	    rba_partition_queue(part, RBA_ADAPTER_REQUEST_LOAD, nullptr, nullptr)) {
+		part->model_state = RBA_ADAPTER_MODEL_LOADING;
+		return true;
+	}
+
+	if (part->running)
+		return false;
+
+	part->model_state = rba_partition_initialize(part) ?
+		RBA_ADAPTER_MODEL_READY : RBA_ADAPTER_MODEL_FAILED;
+	return part->model_state == RBA_ADAPTER_MODEL_READY;
+}
+
+static void
+rba_partition_watch(struct rba_partition *part);
+
+static struct rba_partition *
+rba_adapter_create_partition(const string &path)
+{
+	struct rba_partition *part = new rba_partition;
+
+	part->path = path;
+	adapter.partitions.emplace_back(part);
+
+	if (adapter.threaded && !rba_partition_start(part))
+		weston_log("RBA arbitration for %s will run on the main "
+			   "thread\n", path.c_str());
+	if (adapter.watching)
+		rba_partition_watch(part);
+
+	return part;
+}
+
+static struct rba_partition *
+rba_adapter_get_partition(const struct ivi_output *output)
+{
+	struct rba_partition *part = adapter.fallback;
+	char *path = NULL;
+
+	if (!output)
+		return part;
+
+	auto it = adapter.by_output.find(output);
+	if (it != adapter.by_output.end())
+		return it->second;
+
+	if (output->config)
+		weston_config_section_get_string(output->config, "rba-model",
+						 &path, NULL);
+	if (path) {
+		part = nullptr;
+		for (auto &p : adapter.partitions) {
+			if (p->path == path) {
+				part = p.get();
+				break;
+			}
+		}
+
+		if (!part) {
+			part = rba_adapter_create_partition(path);
+			rba_partition_load(part);
+		}
+		weston_log("Output %s arbitrated with RBA model %s\n",
+			   output->name, path);
+		free(path);
+	}
+
+	adapter.by_output.emplace(output, part);
+	return part;
+}
+
+bool rba_adapter_start(struct wl_event_loop *loop,
+		       rba_adapter_verdict_func_t verdict,
+		       rba_adapter_scene_func_t scene)
+{
+	if (adapter.fallback)
+		return adapter.threaded;
+
+	adapter.loop = loop;
+	adapter.verdict = verdict;
+	adapter.scene = scene;
+	adapter.threaded = true;
+
+	adapter.fallback = rba_adapter_create_partition(JSONFILE);
+	adapter.threaded = adapter.fallback->running;
+
+	return adapter.threaded;
+}
+
+void rba_adapter_stop(void)
+{
+	for (auto &part : adapter.partitions)
+		rba_partition_stop(part.get());
+}
+
+bool rba_adapter_initialize(void)
+{
+	return rba_partition_initialize(adapter.fallback);
+}
+
+bool rba_adapter_initialize_async(void)
+{
+	struct rba_partition *part = adapter.fallback;
+
+	if (!rba_partition_queue(part, RBA_ADAPTER_REQUEST_LOAD, nullptr, nullptr))
 		return false;
+
+	part->model_state = RBA_ADAPTER_MODEL_LOADING;
+	return true;
+}
+
+bool rba_adapter_ensure_model(void)
+{
+	struct rba_partition *part = adapter.fallback;
+
+	if (!part->running)
+		return rba_partition_initialize(part);
+
+	switch (part->model_state) {
+	case RBA_ADAPTER_MODEL_NONE:
+		return rba_adapter_initialize_async();
+	case RBA_ADAPTER_MODEL_FAILED:
+		return false;
+	default:
+		/* activations queue up behind the load */
+		return true;
+	}
+}
+
+bool rba_adapter_arbitrate(struct ivi_output *output, const char *app_id)
+{
+	return rba_partition_arbitrate(rba_adapter_get_partition(output),
+				       app_id);
+}
+
+bool rba_adapter_is_async(struct ivi_output *output)
+{
+	return rba_adapter_get_partition(output)->running;
+}
+
+struct rba_adapter_request *
+rba_adapter_arbitrate_async(struct ivi_output *output, const char *app_id,
+			    void *data)
+{
+	return rba_partition_queue(rba_adapter_get_partition(output),
+				   RBA_ADAPTER_REQUEST_ARBITRATE, app_id, data);
+}
+
+void rba_adapter_set_scene(struct ivi_output *output, const char *scene,
+			   bool active, void *data)
+{
+	struct rba_partition *part = rba_adapter_get_partition(output);
+	vector<struct rba_adapter_area> areas;
+
+	if (rba_partition_set_scene(part, scene, active, areas))
+		rba_adapter_scene_done(data, areas);
+}
+
+struct rba_adapter_request *
+rba_adapter_set_scene_async(struct ivi_output *output, const char *scene,
+			    bool active, void *data)
+{
+	struct rba_adapter_request *req;
+
+	struct rba_partition *part = rba_adapter_get_partition(output);
+
+	req = rba_partition_request(part, RBA_ADAPTER_REQUEST_SCENE, scene,
+				    data);
+	if (req) {
+		req->active = active;
+		rba_partition_submit(part, req);
+	}
+
+	return req;
+}
+
+void rba_adapter_cancel(struct rba_adapter_request *req)
+{
+	req->cancelled.store(true, memory_order_relaxed);
+}
+
+static void
+rba_partition_build(struct rba_partition *part)
+{
+	rba::RBAJsonParser parser;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	deferred_log = &part->reload_log;
+
+	part->new_model = parser.parse(part->path.c_str());
+	if (part->new_model) {
+		part->new_arb = new rba::RBAArbitrator(part->new_model);
+		rba_adapter_log("RBA model %s rebuilt in %ld ms\n",
+				part->path.c_str(),
+				rba_adapter_elapsed_ms(start));
+	} else {
+		rba_adapter_log("Failed to parse %s, keeping the current "
+				"RBA model\n", part->path.c_str());
+	}
+
+	deferred_log = nullptr;
+	rba_adapter_kick(part->done_fd);
+}
+
+static void
+rba_partition_reload_start(struct rba_partition *part)
+{
+	if (part->building || part->new_arb) {
+		part->again = true;
+		return;
+	}
+
+	part->again = false;
+	try {
+		part->builder = thread(rba_partition_build, part);
+		part->building = true;
+	} catch (const system_error &e) {
+		weston_log("Failed to start the RBA model reload: %s\n",
+			   e.what());
+	}
+}
+
+static void
+rba_partition_reload_apply(struct rba_partition *part)
+{
+	struct rba_adapter_request *req;
+
+	/* the builder owns new_model and new_arb until it has been joined */
+	if (part->building || !part->new_arb)
+		return;
+
+	if (part->running) {
+		req = rba_partition_request(part, RBA_ADAPTER_REQUEST_SWAP,
+					    nullptr, nullptr);
+		/* retried once verdicts free up some room */
+		if (!req)
+			return;
+
+		req->model = part->new_model;
+		req->arb = part->new_arb;
+		rba_partition_submit(part, req);
+	} else {
+		rba_partition_swap(part, part->new_model, part->new_arb);
+		part->model_state = RBA_ADAPTER_MODEL_READY;
 	}
+
+	part->new_model = nullptr;
+	part->new_arb = nullptr;
+
+	if (part->again)
+		rba_partition_reload_start(part);
+}
+
+static int
+rba_partition_reload_done(int fd, uint32_t mask, void *data)
+{
+	struct rba_partition *part = static_cast<struct rba_partition *>(data);
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return 0;
+
+	part->builder.join();
+	part->building = false;
+
+	if (!part->reload_log.empty()) {
+		weston_log("%s", part->reload_log.c_str());
+		part->reload_log.clear();
+	}
+
+	if (part->new_arb)
+		rba_partition_reload_apply(part);
+	else if (part->again)
+		rba_partition_reload_start(part);
+
+	return 0;
+}
+
+static int
+rba_adapter_model_changed(int fd, uint32_t mask, void *data)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+
+		while (ptr < buf + len) {
+			struct inotify_event *ev =
+				reinterpret_cast<struct inotify_event *>(ptr);
+
+			ptr += sizeof(*ev) + ev->len;
+			if (!ev->len)
+				continue;
+
+			for (auto &part : adapter.partitions) {
+				const string &path = part->path;
+
+				if (part->watch != ev->wd ||
+				    path.compare(path.rfind('/') + 1,
+						 string::npos, ev->name) != 0)
+					continue;
+
+				weston_log("%s changed, reloading the RBA "
+					   "model\n", path.c_str());
+				rba_partition_reload_start(part.get());
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void
+rba_partition_watch(struct rba_partition *part)
+{
+	/* watch the directory, editors and package managers usually
+	 * replace the file rather than write to it */
+	string dir = part->path.substr(0, part->path.rfind('/'));
+
+	part->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (part->done_fd < 0)
+		goto err;
+
+	part->done_source =
+		wl_event_loop_add_fd(adapter.loop, part->done_fd,
+				     WL_EVENT_READABLE,
+				     rba_partition_reload_done, part);
+	if (!part->done_source)
+		goto err;
+
+	part->watch = inotify_add_watch(adapter.inotify_fd,
+					dir.empty() ? "/" : dir.c_str(),
+					IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (part->watch < 0)
+		goto err;
+
+	return;
+
+err:
+	weston_log("Unable to watch %s for changes: %s\n",
+		   part->path.c_str(), strerror(errno));
+	if (part->done_source)
+		wl_event_source_remove(part->done_source);
+	part->done_source = nullptr;
+	if (part->done_fd >= 0)
+		close(part->done_fd);
+	part->done_fd = -1;
+}
+
+bool rba_adapter_watch(struct wl_event_loop *loop)
+{
+	adapter.loop = loop;
+
+	adapter.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (adapter.inotify_fd < 0)
+		goto err;
+
+	adapter.inotify_source =
+		wl_event_loop_add_fd(loop, adapter.inotify_fd,
+				     WL_EVENT_READABLE,
+				     rba_adapter_model_changed, nullptr);
+	if (!adapter.inotify_source)
+		goto err;
+
+	adapter.watching = true;
+	for (auto &part : adapter.partitions)
+		rba_partition_watch(part.get());
+
 	return true;
+
+err:
+	weston_log("Unable to watch RBA models for changes: %s\n",
+		   strerror(errno));
+	if (adapter.inotify_fd >= 0)
+		close(adapter.inotify_fd);
+	adapter.inotify_fd = -1;
+	return false;
+}
+
+void rba_adapter_unwatch(void)
+{
+	for (auto &part : adapter.partitions) {
+		if (part->building) {
+			part->builder.join();
+			part->building = false;
+		}
+
+		delete part->new_arb;
+		delete part->new_model;
+		part->new_arb = nullptr;
+		part->new_model = nullptr;
+		part->reload_log.clear();
+
+		if (part->done_source)
+			wl_event_source_remove(part->done_source);
+		part->done_source = nullptr;
+		if (part->done_fd >= 0)
+			close(part->done_fd);
+		part->done_fd = -1;
+		part->watch = -1;
+	}
+
+	if (adapter.inotify_source)
+		wl_event_source_remove(adapter.inotify_source);
+	adapter.inotify_source = nullptr;
+	if (adapter.inotify_fd >= 0)
+		close(adapter.inotify_fd);
+	adapter.inotify_fd = -1;
+	adapter.watching = false;
 }
@@ -25,12 +25,73 @@
 
 //This file is helper file to call c++ func
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void rba_adapter_configure(struct ivi_compositor *ivi);
 bool rba_adapter_initialize(void);
-bool rba_adapter_arbitrate(const char *app_id, struct ivi_compositor *ivi);
+/* builds the default arbitrator on its worker thread, see
+ * rba_adapter_start() */
+bool rba_adapter_initialize_async(void);
+/* false if the default arbitrator isn't there and won't be */
+bool rba_adapter_ensure_model(void);
+
+struct wl_event_loop;
+struct ivi_output;
+struct rba_adapter_request;
+
+/* outputs are arbitrated by the model set with 'rba-model' in their
+ * [output] section, or by the default one */
+bool rba_adapter_arbitrate(struct ivi_output *output, const char *app_id);
+
+/* called from the event loop with the data passed to
+ * rba_adapter_arbitrate_async() */
+typedef void (*rba_adapter_verdict_func_t)(void *data, bool allowed);
+
+/* content shown in an area, in output coordinates, as of the last result */
+struct rba_adapter_allocation {
+	const char *app_id;
+	int32_t x, y;
+	int32_t width, height;
+};
+
+/* called with the visible areas once a scene got (de)activated */
+typedef void (*rba_adapter_scene_func_t)(void *data,
+					 const struct rba_adapter_allocation *allocs,
+					 size_t count);
+
+bool rba_adapter_start(struct wl_event_loop *loop,
+		       rba_adapter_verdict_func_t verdict,
+		       rba_adapter_scene_func_t scene);
+void rba_adapter_stop(void);
+
+/* rebuilds the arbitrator whenever the model file changes */
+bool rba_adapter_watch(struct wl_event_loop *loop);
+void rba_adapter_unwatch(void);
+
+/* whether the output is arbitrated on a worker thread, which the
+ * asynchronous versions below need; otherwise it's the synchronous ones */
+bool rba_adapter_is_async(struct ivi_output *output);
+
+/* returns NULL if the request couldn't be queued; once cancelled, the
+ * verdict callback won't be called for it */
+struct rba_adapter_request *
+rba_adapter_arbitrate_async(struct ivi_output *output, const char *app_id,
+			    void *data);
+
+/* the scene callback is called straight away, or from the event loop for
+ * the asynchronous version */
+void rba_adapter_set_scene(struct ivi_output *output, const char *scene,
+			   bool active, void *data);
+struct rba_adapter_request *
+rba_adapter_set_scene_async(struct ivi_output *output, const char *scene,
+			    bool active, void *data);
+
+void rba_adapter_cancel(struct rba_adapter_request *req);
 #ifdef __cplusplus
 }
 #endif
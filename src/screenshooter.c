@@ -26,10 +26,16 @@
 #include "ivi-compositor.h"
 #include "shared/helpers.h"
 
+#include <string.h>
+
 #include <libweston/libweston.h>
 #include "agl-screenshooter-server-protocol.h"
 #include <libweston/weston-log.h>
 
+#define SCREENSHOOTER_RING_MAX_SLOTS	16
+/* past this many damage rectangles, a frame sends their extents instead */
+#define SCREENSHOOTER_STREAM_MAX_RECTS	32
+
 struct screenshooter {
 	struct ivi_compositor *ivi;
 	struct wl_global *global;
@@ -37,6 +43,69 @@ struct screenshooter {
 	struct wl_listener destroy_listener;
 };
 
+struct screenshooter_ring_slot {
+	struct wl_resource *buffer;
+	struct wl_listener buffer_destroy_listener;
+	bool busy;
+};
+
+/* A ring of client buffers filled in straight from the renderer on every
+ * repaint of the output. The buffers are validated once, when added, so
+ * the per-frame path is just a read_pixels() into mapped shm memory. */
+struct screenshooter_ring {
+	struct wl_resource *resource;
+	struct weston_output *output;
+
+	struct screenshooter_ring_slot slots[SCREENSHOOTER_RING_MAX_SLOTS];
+	uint32_t count;
+	uint32_t next;
+	uint32_t dropped;
+	bool started;
+	bool stopped;
+
+	/* scratch row for flipping the frame in place */
+	uint8_t *row;
+
+	struct wl_listener frame_listener;
+	struct wl_listener output_destroy_listener;
+};
+
+/* A pending take_shot_region, completed on the next repaint of the output;
+ * any of the objects involved going away first cancels it. */
+struct screenshooter_region_shot {
+	struct wl_resource *resource;
+	struct wl_resource *buffer;
+	struct weston_output *output;
+	int32_t x, y, width, height;
+
+	/* scratch row for flipping the rectangle in place */
+	uint8_t *row;
+
+	struct wl_listener frame_listener;
+	struct wl_listener resource_destroy_listener;
+	struct wl_listener buffer_destroy_listener;
+	struct wl_listener output_destroy_listener;
+};
+
+/* A single client buffer kept up to date with the output by copying only
+ * what got damaged. Damage piles up in 'pending' while the client holds the
+ * buffer, and unchanged frames aren't copied, nor sent, at all. */
+struct screenshooter_stream {
+	struct wl_resource *resource;
+	struct wl_resource *buffer;
+	struct weston_output *output;
+
+	pixman_region32_t pending;
+	bool busy;
+
+	/* damaged rectangles are read back here, then copied to the buffer */
+	uint8_t *scratch;
+
+	struct wl_listener frame_listener;
+	struct wl_listener buffer_destroy_listener;
+	struct wl_listener output_destroy_listener;
+};
+
 static void
 screenshooter_done(void *data, enum weston_screenshooter_outcome outcome)
 {
@@ -50,6 +119,63 @@ screenshooter_done(void *data, enum weston_screenshooter_outcome outcome)
 	agl_screenshooter_send_done(resource, outcome);
 }
 
+static void
+screenshooter_flip_rows(uint8_t *pixels, uint8_t *row,
+			int32_t stride, int32_t height)
+{
+	uint8_t *top = pixels;
+	uint8_t *bottom = pixels + (height - 1) * stride;
+
+	while (top < bottom) {
+		memcpy(row, top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row, stride);
+		top += stride;
+		bottom -= stride;
+	}
+}
+
+static void
+screenshooter_swap_rb(uint8_t *pixels, int32_t stride, int32_t height)
+{
+	uint32_t *p = (uint32_t *) pixels;
+	uint32_t *end = (uint32_t *) (pixels + stride * height);
+
+	for (; p < end; p++)
+		*p = (*p & 0xff00ff00) |
+		     ((*p & 0x00ff0000) >> 16) | ((*p & 0x000000ff) << 16);
+}
+
+/* Reads the rectangle, given in top-down framebuffer coordinates, straight
+ * into tightly packed ARGB8888 'pixels'. 'row' is scratch space for one row
+ * of the rectangle. */
+static int
+screenshooter_read_rect(struct weston_output *output, uint8_t *pixels,
+			uint8_t *row, int32_t x, int32_t y,
+			int32_t width, int32_t height)
+{
+	struct weston_compositor *ec = output->compositor;
+	pixman_format_code_t format = ec->read_format;
+	bool yflip = ec->capabilities & WESTON_CAP_CAPTURE_YFLIP;
+	int32_t stride = width * 4;
+	int ret;
+
+	if (yflip)
+		y = output->current_mode->height - y - height;
+
+	ret = ec->renderer->read_pixels(output, format, pixels,
+					x, y, width, height);
+	if (ret < 0)
+		return ret;
+
+	if (yflip)
+		screenshooter_flip_rows(pixels, row, stride, height);
+	if (format == PIXMAN_a8b8g8r8 || format == PIXMAN_x8b8g8r8)
+		screenshooter_swap_rb(pixels, stride, height);
+
+	return 0;
+}
+
 static void
 screenshooter_shoot(struct wl_client *client,
 		    struct wl_resource *resource,
@@ -69,6 +195,739 @@ screenshooter_shoot(struct wl_client *client,
 	weston_screenshooter_shoot(output, buffer, screenshooter_done, resource);
 }
 
+static void
+screenshooter_region_shot_destroy(struct screenshooter_region_shot *shot)
+{
+	wl_list_remove(&shot->frame_listener.link);
+	wl_list_remove(&shot->resource_destroy_listener.link);
+	wl_list_remove(&shot->buffer_destroy_listener.link);
+	wl_list_remove(&shot->output_destroy_listener.link);
+
+	weston_output_disable_planes_decr(shot->output);
+
+	free(shot->row);
+	free(shot);
+}
+
+static void
+screenshooter_region_shot_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_region_shot *shot =
+		container_of(listener, struct screenshooter_region_shot,
+			     frame_listener);
+	struct weston_output *output = shot->output;
+	struct wl_shm_buffer *shm = wl_shm_buffer_get(shot->buffer);
+	enum agl_screenshooter_done_status status =
+		AGL_SCREENSHOOTER_DONE_STATUS_SUCCESS;
+	int ret;
+
+	/* the mode might have changed since the request was made */
+	if (shot->x + shot->width > output->current_mode->width ||
+	    shot->y + shot->height > output->current_mode->height) {
+		status = AGL_SCREENSHOOTER_DONE_STATUS_BAD_REGION;
+	} else {
+		wl_shm_buffer_begin_access(shm);
+		ret = screenshooter_read_rect(output,
+					      wl_shm_buffer_get_data(shm),
+					      shot->row, shot->x, shot->y,
+					      shot->width, shot->height);
+		wl_shm_buffer_end_access(shm);
+
+		if (ret < 0)
+			status = AGL_SCREENSHOOTER_DONE_STATUS_NO_MEMORY;
+	}
+
+	agl_screenshooter_send_done(shot->resource, status);
+	screenshooter_region_shot_destroy(shot);
+}
+
+static void
+screenshooter_region_shot_resource_destroyed(struct wl_listener *listener,
+					     void *data)
+{
+	struct screenshooter_region_shot *shot =
+		container_of(listener, struct screenshooter_region_shot,
+			     resource_destroy_listener);
+
+	screenshooter_region_shot_destroy(shot);
+}
+
+static void
+screenshooter_region_shot_buffer_destroyed(struct wl_listener *listener,
+					   void *data)
+{
+	struct screenshooter_region_shot *shot =
+		container_of(listener, struct screenshooter_region_shot,
+			     buffer_destroy_listener);
+
+	agl_screenshooter_send_done(shot->resource,
+				    AGL_SCREENSHOOTER_DONE_STATUS_BAD_BUFFER);
+	screenshooter_region_shot_destroy(shot);
+}
+
+static void
+screenshooter_region_shot_output_destroyed(struct wl_listener *listener,
+					   void *data)
+{
+	struct screenshooter_region_shot *shot =
+		container_of(listener, struct screenshooter_region_shot,
+			     output_destroy_listener);
+
+	agl_screenshooter_send_done(shot->resource,
+				    AGL_SCREENSHOOTER_DONE_STATUS_BAD_REGION);
+	screenshooter_region_shot_destroy(shot);
+}
+
+static void
+screenshooter_shoot_region(struct wl_client *client,
+			   struct wl_resource *resource,
+			   struct wl_resource *output_resource,
+			   struct wl_resource *buffer_resource,
+			   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct weston_head *head = weston_head_from_resource(output_resource);
+	struct weston_output *output = head ? head->output : NULL;
+	struct screenshooter_region_shot *shot;
+	struct wl_shm_buffer *shm;
+	uint32_t format = 0;
+
+	if (!output || x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x > output->current_mode->width - width ||
+	    y > output->current_mode->height - height) {
+		agl_screenshooter_send_done(resource,
+					    AGL_SCREENSHOOTER_DONE_STATUS_BAD_REGION);
+		return;
+	}
+
+	/* the rectangle is read straight into the buffer, which has to
+	 * match it exactly */
+	shm = wl_shm_buffer_get(buffer_resource);
+	if (shm)
+		format = wl_shm_buffer_get_format(shm);
+	if (!shm ||
+	    (format != WL_SHM_FORMAT_XRGB8888 &&
+	     format != WL_SHM_FORMAT_ARGB8888) ||
+	    wl_shm_buffer_get_width(shm) != width ||
+	    wl_shm_buffer_get_height(shm) != height ||
+	    wl_shm_buffer_get_stride(shm) != width * 4) {
+		agl_screenshooter_send_done(resource,
+					    AGL_SCREENSHOOTER_DONE_STATUS_BAD_BUFFER);
+		return;
+	}
+
+	shot = zalloc(sizeof(*shot));
+	if (shot)
+		shot->row = malloc(width * 4);
+	if (!shot || !shot->row) {
+		free(shot);
+		agl_screenshooter_send_done(resource,
+					    AGL_SCREENSHOOTER_DONE_STATUS_NO_MEMORY);
+		return;
+	}
+
+	shot->resource = resource;
+	shot->buffer = buffer_resource;
+	shot->output = output;
+	shot->x = x;
+	shot->y = y;
+	shot->width = width;
+	shot->height = height;
+
+	shot->frame_listener.notify = screenshooter_region_shot_frame_notify;
+	wl_signal_add(&output->frame_signal, &shot->frame_listener);
+
+	shot->resource_destroy_listener.notify =
+		screenshooter_region_shot_resource_destroyed;
+	wl_resource_add_destroy_listener(resource,
+					 &shot->resource_destroy_listener);
+
+	shot->buffer_destroy_listener.notify =
+		screenshooter_region_shot_buffer_destroyed;
+	wl_resource_add_destroy_listener(buffer_resource,
+					 &shot->buffer_destroy_listener);
+
+	shot->output_destroy_listener.notify =
+		screenshooter_region_shot_output_destroyed;
+	wl_signal_add(&output->destroy_signal, &shot->output_destroy_listener);
+
+	weston_output_disable_planes_incr(output);
+	weston_output_schedule_repaint(output);
+}
+
+static struct screenshooter_ring_slot *
+screenshooter_ring_get_free_slot(struct screenshooter_ring *ring)
+{
+	uint32_t i;
+
+	for (i = 0; i < ring->count; i++) {
+		struct screenshooter_ring_slot *slot =
+			&ring->slots[(ring->next + i) % ring->count];
+
+		if (slot->buffer && !slot->busy) {
+			ring->next = (ring->next + i + 1) % ring->count;
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+screenshooter_ring_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_ring *ring =
+		container_of(listener, struct screenshooter_ring, frame_listener);
+	struct weston_output *output = ring->output;
+	struct screenshooter_ring_slot *slot;
+	struct wl_shm_buffer *shm;
+	int32_t width = output->current_mode->width;
+	int32_t height = output->current_mode->height;
+	uint64_t tv_sec;
+	int ret;
+
+	slot = screenshooter_ring_get_free_slot(ring);
+	if (!slot) {
+		ring->dropped++;
+		return;
+	}
+
+	shm = wl_shm_buffer_get(slot->buffer);
+	if (wl_shm_buffer_get_width(shm) != width ||
+	    wl_shm_buffer_get_height(shm) != height) {
+		/* the mode changed under us */
+		ring->dropped++;
+		return;
+	}
+
+	wl_shm_buffer_begin_access(shm);
+	ret = screenshooter_read_rect(output, wl_shm_buffer_get_data(shm),
+				      ring->row, 0, 0, width, height);
+	wl_shm_buffer_end_access(shm);
+
+	if (ret < 0) {
+		ring->dropped++;
+		return;
+	}
+
+	slot->busy = true;
+
+	tv_sec = output->frame_time.tv_sec;
+	agl_screenshooter_ring_send_ready(ring->resource,
+					  slot - ring->slots,
+					  tv_sec >> 32, tv_sec & 0xffffffff,
+					  output->frame_time.tv_nsec,
+					  ring->dropped);
+	ring->dropped = 0;
+}
+
+static void
+screenshooter_ring_stop(struct screenshooter_ring *ring)
+{
+	if (!ring->started)
+		return;
+
+	wl_list_remove(&ring->frame_listener.link);
+	weston_output_disable_planes_decr(ring->output);
+	ring->started = false;
+}
+
+/* lets the client know it can't wait on frames anymore */
+static void
+screenshooter_ring_send_stopped(struct screenshooter_ring *ring)
+{
+	if (ring->stopped ||
+	    wl_resource_get_version(ring->resource) <
+	    AGL_SCREENSHOOTER_RING_STOPPED_SINCE_VERSION)
+		return;
+
+	agl_screenshooter_ring_send_stopped(ring->resource);
+	ring->stopped = true;
+}
+
+static void
+screenshooter_ring_output_destroyed(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_ring *ring =
+		container_of(listener, struct screenshooter_ring,
+			     output_destroy_listener);
+
+	/* otherwise sent on 'start' */
+	if (ring->started)
+		screenshooter_ring_send_stopped(ring);
+
+	screenshooter_ring_stop(ring);
+	wl_list_remove(&ring->output_destroy_listener.link);
+	ring->output = NULL;
+}
+
+static void
+screenshooter_ring_buffer_destroyed(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_ring_slot *slot =
+		container_of(listener, struct screenshooter_ring_slot,
+			     buffer_destroy_listener);
+
+	wl_list_remove(&slot->buffer_destroy_listener.link);
+	slot->buffer = NULL;
+}
+
+static void
+screenshooter_ring_add_buffer(struct wl_client *client,
+			      struct wl_resource *resource,
+			      struct wl_resource *buffer_resource)
+{
+	struct screenshooter_ring *ring = wl_resource_get_user_data(resource);
+	struct screenshooter_ring_slot *slot;
+	struct wl_shm_buffer *shm;
+	uint32_t format;
+
+	if (ring->started) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_ALREADY_STARTED,
+				       "buffers must be added before start");
+		return;
+	}
+
+	if (ring->count == SCREENSHOOTER_RING_MAX_SLOTS) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_TOO_MANY_BUFFERS,
+				       "at most %d buffers can be added",
+				       SCREENSHOOTER_RING_MAX_SLOTS);
+		return;
+	}
+
+	shm = wl_shm_buffer_get(buffer_resource);
+	if (!shm) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_BAD_BUFFER,
+				       "buffer isn't a wl_shm buffer");
+		return;
+	}
+
+	format = wl_shm_buffer_get_format(shm);
+	if ((format != WL_SHM_FORMAT_XRGB8888 &&
+	     format != WL_SHM_FORMAT_ARGB8888) ||
+	    wl_shm_buffer_get_stride(shm) != wl_shm_buffer_get_width(shm) * 4) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_BAD_BUFFER,
+				       "buffer format or stride not supported");
+		return;
+	}
+
+	if (ring->output &&
+	    (wl_shm_buffer_get_width(shm) != ring->output->current_mode->width ||
+	     wl_shm_buffer_get_height(shm) != ring->output->current_mode->height)) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_BAD_BUFFER,
+				       "buffer size doesn't match the output's");
+		return;
+	}
+
+	slot = &ring->slots[ring->count++];
+	slot->buffer = buffer_resource;
+	slot->busy = false;
+	slot->buffer_destroy_listener.notify = screenshooter_ring_buffer_destroyed;
+	wl_resource_add_destroy_listener(buffer_resource,
+					 &slot->buffer_destroy_listener);
+}
+
+static void
+screenshooter_ring_start(struct wl_client *client,
+			 struct wl_resource *resource)
+{
+	struct screenshooter_ring *ring = wl_resource_get_user_data(resource);
+	struct weston_output *output = ring->output;
+	uint32_t i;
+
+	if (ring->started)
+		return;
+
+	if (!output) {
+		screenshooter_ring_send_stopped(ring);
+		return;
+	}
+
+	ring->row = malloc(output->current_mode->width * 4);
+	if (!ring->row) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	for (i = 0; i < ring->count; i++)
+		ring->slots[i].busy = false;
+	ring->next = 0;
+	ring->dropped = 0;
+
+	/* everything has to go through the renderer to be captured */
+	weston_output_disable_planes_incr(output);
+
+	ring->frame_listener.notify = screenshooter_ring_frame_notify;
+	wl_signal_add(&output->frame_signal, &ring->frame_listener);
+	ring->started = true;
+
+	weston_output_schedule_repaint(output);
+}
+
+static void
+screenshooter_ring_release(struct wl_client *client,
+			   struct wl_resource *resource, uint32_t slot)
+{
+	struct screenshooter_ring *ring = wl_resource_get_user_data(resource);
+
+	if (slot >= ring->count) {
+		wl_resource_post_error(resource,
+				       AGL_SCREENSHOOTER_RING_ERROR_BAD_SLOT,
+				       "slot %u doesn't exist", slot);
+		return;
+	}
+
+	ring->slots[slot].busy = false;
+}
+
+static void
+screenshooter_ring_destroy_request(struct wl_client *client,
+				   struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct agl_screenshooter_ring_interface screenshooter_ring_implementation = {
+	screenshooter_ring_add_buffer,
+	screenshooter_ring_start,
+	screenshooter_ring_release,
+	screenshooter_ring_destroy_request,
+};
+
+static void
+screenshooter_ring_destroy(struct wl_resource *resource)
+{
+	struct screenshooter_ring *ring = wl_resource_get_user_data(resource);
+	uint32_t i;
+
+	screenshooter_ring_stop(ring);
+	if (ring->output)
+		wl_list_remove(&ring->output_destroy_listener.link);
+
+	for (i = 0; i < ring->count; i++)
+		if (ring->slots[i].buffer)
+			wl_list_remove(&ring->slots[i].buffer_destroy_listener.link);
+
+	free(ring->row);
+	free(ring);
+}
+
+static void
+screenshooter_create_ring(struct wl_client *client,
+			  struct wl_resource *resource, uint32_t id,
+			  struct wl_resource *output_resource)
+{
+	struct weston_head *head = weston_head_from_resource(output_resource);
+	struct screenshooter_ring *ring;
+
+	ring = zalloc(sizeof(*ring));
+	if (!ring) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	ring->resource = wl_resource_create(client,
+					    &agl_screenshooter_ring_interface,
+					    wl_resource_get_version(resource), id);
+	if (!ring->resource) {
+		free(ring);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(ring->resource,
+				       &screenshooter_ring_implementation,
+				       ring, screenshooter_ring_destroy);
+
+	/* an output which is already gone gives an inert ring */
+	if (head && head->output) {
+		ring->output = head->output;
+		ring->output_destroy_listener.notify =
+			screenshooter_ring_output_destroyed;
+		wl_signal_add(&ring->output->destroy_signal,
+			      &ring->output_destroy_listener);
+	}
+}
+
+static void
+screenshooter_stream_add_damage(struct screenshooter_stream *stream,
+				pixman_region32_t *damage)
+{
+	struct weston_output *output = stream->output;
+	pixman_region32_t region;
+
+	/* output damage is in global coordinates, the buffer is a copy of
+	 * the framebuffer */
+	pixman_region32_init(&region);
+	pixman_region32_copy(&region, damage);
+	pixman_region32_translate(&region, -output->x, -output->y);
+	weston_transformed_region(output->width, output->height,
+				  output->transform, output->current_scale,
+				  &region, &region);
+	pixman_region32_intersect_rect(&region, &region, 0, 0,
+				       output->current_mode->width,
+				       output->current_mode->height);
+
+	pixman_region32_union(&stream->pending, &stream->pending, &region);
+	pixman_region32_fini(&region);
+}
+
+static int
+screenshooter_stream_copy_rect(struct screenshooter_stream *stream,
+			       uint8_t *dst, int32_t dst_stride,
+			       pixman_box32_t *box)
+{
+	int32_t width = box->x2 - box->x1;
+	int32_t height = box->y2 - box->y1;
+	int32_t row_size = width * 4;
+	uint8_t *src = stream->scratch;
+	/* the row needed for the flip sits right past the rectangle */
+	uint8_t *row = stream->scratch + row_size * height;
+	int32_t i;
+
+	if (screenshooter_read_rect(stream->output, src, row,
+				    box->x1, box->y1, width, height) < 0)
+		return -1;
+
+	dst += box->y1 * dst_stride + box->x1 * 4;
+	for (i = 0; i < height; i++) {
+		memcpy(dst, src, row_size);
+		dst += dst_stride;
+		src += row_size;
+	}
+
+	return 0;
+}
+
+static void
+screenshooter_stream_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_stream *stream =
+		container_of(listener, struct screenshooter_stream,
+			     frame_listener);
+	struct weston_output *output = stream->output;
+	struct wl_shm_buffer *shm = wl_shm_buffer_get(stream->buffer);
+	pixman_box32_t *boxes;
+	uint64_t tv_sec;
+	uint8_t *pixels;
+	int32_t stride;
+	int n_boxes, i;
+
+	/* what this repaint changed, the signal itself only carries the
+	 * output */
+	screenshooter_stream_add_damage(stream, &output->previous_damage);
+
+	if (stream->busy || !pixman_region32_not_empty(&stream->pending))
+		return;
+
+	/* the mode changed under us, wait for the client to catch up */
+	if (wl_shm_buffer_get_width(shm) != output->current_mode->width ||
+	    wl_shm_buffer_get_height(shm) != output->current_mode->height)
+		return;
+
+	boxes = pixman_region32_rectangles(&stream->pending, &n_boxes);
+	if (n_boxes > SCREENSHOOTER_STREAM_MAX_RECTS) {
+		boxes = pixman_region32_extents(&stream->pending);
+		n_boxes = 1;
+	}
+
+	stride = wl_shm_buffer_get_stride(shm);
+
+	wl_shm_buffer_begin_access(shm);
+	pixels = wl_shm_buffer_get_data(shm);
+	for (i = 0; i < n_boxes; i++)
+		if (screenshooter_stream_copy_rect(stream, pixels, stride,
+						   &boxes[i]) < 0)
+			break;
+	wl_shm_buffer_end_access(shm);
+
+	/* keep the damage around and try again next frame */
+	if (i < n_boxes)
+		return;
+
+	for (i = 0; i < n_boxes; i++)
+		agl_screenshooter_stream_send_damage(stream->resource,
+						     boxes[i].x1, boxes[i].y1,
+						     boxes[i].x2 - boxes[i].x1,
+						     boxes[i].y2 - boxes[i].y1);
+
+	tv_sec = output->frame_time.tv_sec;
+	agl_screenshooter_stream_send_frame(stream->resource,
+					    tv_sec >> 32, tv_sec & 0xffffffff,
+					    output->frame_time.tv_nsec);
+
+	pixman_region32_clear(&stream->pending);
+	stream->busy = true;
+}
+
+static void
+screenshooter_stream_stop(struct screenshooter_stream *stream)
+{
+	if (!stream->output)
+		return;
+
+	wl_list_remove(&stream->frame_listener.link);
+	wl_list_remove(&stream->output_destroy_listener.link);
+	weston_output_disable_planes_decr(stream->output);
+	stream->output = NULL;
+}
+
+static void
+screenshooter_stream_output_destroyed(struct wl_listener *listener,
+				      void *data)
+{
+	struct screenshooter_stream *stream =
+		container_of(listener, struct screenshooter_stream,
+			     output_destroy_listener);
+
+	screenshooter_stream_stop(stream);
+}
+
+static void
+screenshooter_stream_buffer_destroyed(struct wl_listener *listener,
+				      void *data)
+{
+	struct screenshooter_stream *stream =
+		container_of(listener, struct screenshooter_stream,
+			     buffer_destroy_listener);
+
+	wl_list_remove(&stream->buffer_destroy_listener.link);
+	stream->buffer = NULL;
+	screenshooter_stream_stop(stream);
+}
+
+static void
+screenshooter_stream_release(struct wl_client *client,
+			     struct wl_resource *resource)
+{
+	struct screenshooter_stream *stream =
+		wl_resource_get_user_data(resource);
+
+	stream->busy = false;
+
+	/* whatever got damaged meanwhile goes out with the next repaint */
+	if (stream->output && pixman_region32_not_empty(&stream->pending))
+		weston_output_schedule_repaint(stream->output);
+}
+
+static void
+screenshooter_stream_destroy_request(struct wl_client *client,
+				     struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct agl_screenshooter_stream_interface screenshooter_stream_implementation = {
+	screenshooter_stream_release,
+	screenshooter_stream_destroy_request,
+};
+
+static void
+screenshooter_stream_destroy(struct wl_resource *resource)
+{
+	struct screenshooter_stream *stream =
+		wl_resource_get_user_data(resource);
+
+	screenshooter_stream_stop(stream);
+	if (stream->buffer)
+		wl_list_remove(&stream->buffer_destroy_listener.link);
+
+	pixman_region32_fini(&stream->pending);
+	free(stream->scratch);
+	free(stream);
+}
+
+static void
+screenshooter_create_stream(struct wl_client *client,
+			    struct wl_resource *resource, uint32_t id,
+			    struct wl_resource *output_resource,
+			    struct wl_resource *buffer_resource)
+{
+	struct weston_head *head = weston_head_from_resource(output_resource);
+	struct weston_output *output = head ? head->output : NULL;
+	struct screenshooter_stream *stream;
+	struct wl_shm_buffer *shm;
+	uint32_t format = 0;
+	int32_t width, height;
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	stream->resource = wl_resource_create(client,
+					      &agl_screenshooter_stream_interface,
+					      wl_resource_get_version(resource), id);
+	if (!stream->resource) {
+		free(stream);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	pixman_region32_init(&stream->pending);
+	wl_resource_set_implementation(stream->resource,
+				       &screenshooter_stream_implementation,
+				       stream, screenshooter_stream_destroy);
+
+	/* an output which is already gone gives an inert stream */
+	if (!output)
+		return;
+
+	width = output->current_mode->width;
+	height = output->current_mode->height;
+
+	shm = wl_shm_buffer_get(buffer_resource);
+	if (shm)
+		format = wl_shm_buffer_get_format(shm);
+	if (!shm ||
+	    (format != WL_SHM_FORMAT_XRGB8888 &&
+	     format != WL_SHM_FORMAT_ARGB8888) ||
+	    wl_shm_buffer_get_width(shm) != width ||
+	    wl_shm_buffer_get_height(shm) != height ||
+	    wl_shm_buffer_get_stride(shm) < width * 4) {
+		wl_resource_post_error(stream->resource,
+				       AGL_SCREENSHOOTER_STREAM_ERROR_BAD_BUFFER,
+				       "buffer isn't a wl_shm buffer of the "
+				       "output's size and format");
+		return;
+	}
+
+	/* room for a whole frame plus a row to flip it */
+	stream->scratch = malloc((size_t) width * 4 * (height + 1));
+	if (!stream->scratch) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	stream->buffer = buffer_resource;
+	stream->buffer_destroy_listener.notify =
+		screenshooter_stream_buffer_destroyed;
+	wl_resource_add_destroy_listener(buffer_resource,
+					 &stream->buffer_destroy_listener);
+
+	stream->output = output;
+	stream->output_destroy_listener.notify =
+		screenshooter_stream_output_destroyed;
+	wl_signal_add(&output->destroy_signal,
+		      &stream->output_destroy_listener);
+
+	stream->frame_listener.notify = screenshooter_stream_frame_notify;
+	wl_signal_add(&output->frame_signal, &stream->frame_listener);
+
+	/* everything has to go through the renderer to be captured */
+	weston_output_disable_planes_incr(output);
+
+	/* the buffer starts out with the whole output */
+	pixman_region32_union_rect(&stream->pending, &stream->pending,
+				   0, 0, width, height);
+	weston_output_schedule_repaint(output);
+}
+
 static void
 screenshooter_destructor_destroy(struct wl_client *client,
 		                 struct wl_resource *global_resource)
@@ -78,7 +937,10 @@ screenshooter_destructor_destroy(struct wl_client *client,
 
 struct agl_screenshooter_interface screenshooter_implementation = {
 	screenshooter_shoot,
-	screenshooter_destructor_destroy
+	screenshooter_destructor_destroy,
+	screenshooter_create_ring,
+	screenshooter_shoot_region,
+	screenshooter_create_stream,
 };
 
 static void
@@ -90,7 +952,8 @@ bind_shooter(struct wl_client *client,
 	bool debug_enabled = true;
 
 	resource = wl_resource_create(client,
-				      &agl_screenshooter_interface, 1, id);
+				      &agl_screenshooter_interface,
+				      MIN(version, 5), id);
 
 	if (!debug_enabled && !shooter->client) {
 		wl_resource_post_error(resource, WL_DISPLAY_ERROR_INVALID_OBJECT,
@@ -127,7 +990,7 @@ ivi_screenshooter_create(struct ivi_compositor *ivi)
 
 	shooter->ivi = ivi;
 	shooter->global = wl_global_create(ec->wl_display,
-					   &agl_screenshooter_interface, 1,
+					   &agl_screenshooter_interface, 5,
 					   shooter, bind_shooter);
 
 	shooter->destroy_listener.notify = screenshooter_destroy;
@@ -83,6 +83,8 @@ ivi_set_desktop_surface(struct ivi_surface *surface)
 
 	surface->role = IVI_SURFACE_ROLE_DESKTOP;
 	wl_list_insert(&surface->ivi->surfaces, &surface->link);
+	ivi_app_id_index_add(surface);
+	ivi_surface_role_track(surface);
 
 	agl_shell_desktop_advertise_application_id(ivi, surface);
 }
@@ -95,6 +97,8 @@ ivi_set_desktop_surface_popup(struct ivi_surface *surface)
 
 	surface->role = IVI_SURFACE_ROLE_POPUP;
 	wl_list_insert(&ivi->surfaces, &surface->link);
+	ivi_app_id_index_add(surface);
+	ivi_surface_role_track(surface);
 
 	agl_shell_desktop_advertise_application_id(ivi, surface);
 }
@@ -107,6 +111,8 @@ ivi_set_desktop_surface_fullscreen(struct ivi_surface *surface)
 
 	surface->role = IVI_SURFACE_ROLE_FULLSCREEN;
 	wl_list_insert(&ivi->surfaces, &surface->link);
+	ivi_app_id_index_add(surface);
+	ivi_surface_role_track(surface);
 
 	agl_shell_desktop_advertise_application_id(ivi, surface);
 }
@@ -217,6 +223,8 @@ ivi_set_desktop_surface_remote(struct ivi_surface *surface)
 		ivi_output_notify_waltham_plugin(surface);
 
 	wl_list_insert(&ivi->surfaces, &surface->link);
+	ivi_app_id_index_add(surface);
+	ivi_surface_role_track(surface);
 }
 
 
@@ -231,318 +239,230 @@ ivi_set_desktop_surface_split(struct ivi_surface *surface)
 	else
 		surface->role = IVI_SURFACE_ROLE_SPLIT_H;
 
+	wl_list_init(&surface->split.link);
+
 	wl_list_insert(&ivi->surfaces, &surface->link);
+	ivi_app_id_index_add(surface);
+	ivi_surface_role_track(surface);
 
 	agl_shell_desktop_advertise_application_id(ivi, surface);
 }
 
-static void
-ivi_set_pending_desktop_surface_popup(struct ivi_output *ioutput,
-				      int x, int y, int bx, int by, int width, int height,
-				      const char *app_id)
+static struct pending_app *
+ivi_find_pending_app(struct ivi_compositor *ivi, const char *app_id,
+		     uint32_t hash)
 {
-	struct ivi_compositor *ivi = ioutput->ivi;
-	size_t len_app_id = strlen(app_id);
-
-	struct pending_popup *p_popup = zalloc(sizeof(*p_popup));
+	struct wl_list *bucket;
+	struct pending_app *papp;
 
-	p_popup->app_id = zalloc(sizeof(char) * (len_app_id + 1));
-	memcpy(p_popup->app_id, app_id, len_app_id);
-	p_popup->ioutput = ioutput;
-	p_popup->x = x;
-	p_popup->y = y;
+	if (!app_id)
+		return NULL;
 
-	p_popup->bb.x = bx;
-	p_popup->bb.y = by;
-	p_popup->bb.width = width;
-	p_popup->bb.height = height;
+	bucket = &ivi->pending_apps[hash & (IVI_APP_ID_HASH_SIZE - 1)];
+	wl_list_for_each(papp, bucket, link)
+		if (papp->app_id_hash == hash && !strcmp(papp->app_id, app_id))
+			return papp;
 
-	wl_list_insert(&ivi->popup_pending_apps, &p_popup->link);
+	return NULL;
 }
 
 static void
-ivi_set_pending_desktop_surface_fullscreen(struct ivi_output *ioutput,
-					   const char *app_id)
+ivi_remove_pending_app(struct pending_app *papp)
 {
-	struct ivi_compositor *ivi = ioutput->ivi;
-	size_t len_app_id = strlen(app_id);
-
-	struct pending_fullscreen *fs = zalloc(sizeof(*fs));
-
-	fs->app_id = zalloc(sizeof(char) * (len_app_id + 1));
-	memcpy(fs->app_id, app_id, len_app_id);
-
-	fs->ioutput = ioutput;
-
-	wl_list_insert(&ivi->fullscreen_pending_apps, &fs->link);
+	free(papp->app_id);
+	wl_list_remove(&papp->link);
+	free(papp);
 }
 
-static void
-ivi_set_pending_desktop_surface_split(struct ivi_output *ioutput,
-				      const char *app_id, uint32_t orientation)
+/*
+ * Returns the entry for app_id with any previously set property dropped: the
+ * last set_app_property request for an application is the one that applies.
+ */
+static struct pending_app *
+ivi_set_pending_app(struct ivi_output *ioutput, const char *app_id,
+		    enum ivi_surface_role role)
 {
 	struct ivi_compositor *ivi = ioutput->ivi;
-	struct ivi_surface *surf;
-	size_t len_app_id = strlen(app_id);
-	struct pending_split *split;
+	uint32_t hash = ivi_app_id_hash(app_id);
+	struct pending_app *papp;
 
-	if (orientation != AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_VERTICAL &&
-	    orientation != AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_HORIZONTAL)
-		return;
+	papp = ivi_find_pending_app(ivi, app_id, hash);
+	if (papp)
+		ivi_remove_pending_app(papp);
 
-	/* more than one is un-supported, do note we need to do
-	 * conversion for surface roles instead of using the protocol ones */
-	wl_list_for_each(surf, &ivi->surfaces, link)
-		if (surf->role == IVI_SURFACE_ROLE_SPLIT_V ||
-		    surf->role == IVI_SURFACE_ROLE_SPLIT_H)
-			return;
+	papp = zalloc(sizeof(*papp));
+	if (!papp)
+		return NULL;
 
-	split = zalloc(sizeof(*split));
-	split->app_id = zalloc(sizeof(char) * (len_app_id + 1));
-	memcpy(split->app_id, app_id, len_app_id);
+	papp->app_id = strdup(app_id);
+	if (!papp->app_id) {
+		free(papp);
+		return NULL;
+	}
 
-	split->ioutput = ioutput;
-	split->orientation = orientation;
+	papp->app_id_hash = hash;
+	papp->ioutput = ioutput;
+	papp->role = role;
 
-	wl_list_insert(&ivi->split_pending_apps, &split->link);
+	wl_list_insert(&ivi->pending_apps[hash & (IVI_APP_ID_HASH_SIZE - 1)],
+		       &papp->link);
+	return papp;
 }
 
-void
-ivi_set_pending_desktop_surface_remote(struct ivi_output *ioutput,
-		const char *app_id)
+static void
+ivi_set_pending_desktop_surface_popup(struct ivi_output *ioutput,
+				      int x, int y, int bx, int by, int width, int height,
+				      const char *app_id)
 {
-	struct ivi_compositor *ivi = ioutput->ivi;
-	size_t len_app_id = strlen(app_id);
+	struct pending_app *papp;
 
-	struct pending_remote *remote = zalloc(sizeof(*remote));
-
-	remote->app_id = zalloc(sizeof(char) * (len_app_id + 1));
-	memcpy(remote->app_id, app_id, len_app_id);
+	papp = ivi_set_pending_app(ioutput, app_id, IVI_SURFACE_ROLE_POPUP);
+	if (!papp)
+		return;
 
-	remote->ioutput = ioutput;
+	papp->popup.x = x;
+	papp->popup.y = y;
 
-	wl_list_insert(&ivi->remote_pending_apps, &remote->link);
+	papp->popup.bb.x = bx;
+	papp->popup.bb.y = by;
+	papp->popup.bb.width = width;
+	papp->popup.bb.height = height;
 }
 
-
 static void
-ivi_remove_pending_desktop_surface_split(struct pending_split *split)
-{
-	free(split->app_id);
-	wl_list_remove(&split->link);
-	free(split);
-}
-
-static void
-ivi_remove_pending_desktop_surface_fullscreen(struct pending_fullscreen *fs)
-{
-	free(fs->app_id);
-	wl_list_remove(&fs->link);
-	free(fs);
-}
-
-static void
-ivi_remove_pending_desktop_surface_popup(struct pending_popup *p_popup)
+ivi_set_pending_desktop_surface_fullscreen(struct ivi_output *ioutput,
+					   const char *app_id)
 {
-	free(p_popup->app_id);
-	wl_list_remove(&p_popup->link);
-	free(p_popup);
+	ivi_set_pending_app(ioutput, app_id, IVI_SURFACE_ROLE_FULLSCREEN);
 }
 
 static void
-ivi_remove_pending_desktop_surface_remote(struct pending_remote *remote)
+ivi_set_pending_desktop_surface_split(struct ivi_output *ioutput,
+				      const char *app_id, uint32_t orientation,
+				      uint32_t ratio)
 {
-	free(remote->app_id);
-	wl_list_remove(&remote->link);
-	free(remote);
-}
+	struct pending_app *papp;
+	enum ivi_surface_role role;
 
-static bool
-ivi_check_pending_desktop_surface_popup(struct ivi_surface *surface)
-{
-	struct ivi_compositor *ivi = surface->ivi;
-	struct pending_popup *p_popup, *next_p_popup;
-	const char *_app_id =
-			weston_desktop_surface_get_app_id(surface->dsurface);
-
-	if (wl_list_empty(&ivi->popup_pending_apps) || !_app_id)
-		return false;
-
-	wl_list_for_each_safe(p_popup, next_p_popup,
-			      &ivi->popup_pending_apps, link) {
-		if (!strcmp(_app_id, p_popup->app_id)) {
-			surface->popup.output = p_popup->ioutput;
-			surface->popup.x = p_popup->x;
-			surface->popup.y = p_popup->y;
+	if (orientation == AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_VERTICAL)
+		role = IVI_SURFACE_ROLE_SPLIT_V;
+	else if (orientation == AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_HORIZONTAL)
+		role = IVI_SURFACE_ROLE_SPLIT_H;
+	else
+		return;
 
-			surface->popup.bb.x = p_popup->bb.x;
-			surface->popup.bb.y = p_popup->bb.y;
-			surface->popup.bb.width = p_popup->bb.width;
-			surface->popup.bb.height = p_popup->bb.height;
+	/* the ratio is a percentage of what's left of the output when the
+	 * surface gets mapped, use an even split if none was given */
+	if (ratio == 0 || ratio >= 100)
+		ratio = 50;
 
-			ivi_remove_pending_desktop_surface_popup(p_popup);
-			return true;
-		}
+	papp = ivi_set_pending_app(ioutput, app_id, role);
+	if (papp) {
+		papp->split.orientation = orientation;
+		papp->split.ratio = ratio;
 	}
-
-	return false;
 }
 
-static bool
-ivi_check_pending_desktop_surface_split(struct ivi_surface *surface)
-{
-	struct pending_split *split_surf, *next_split_surf;
-	struct ivi_compositor *ivi = surface->ivi;
-	const char *_app_id =
-			weston_desktop_surface_get_app_id(surface->dsurface);
-
-	if (wl_list_empty(&ivi->split_pending_apps) || !_app_id)
-		return false;
-
-	wl_list_for_each_safe(split_surf, next_split_surf,
-			      &ivi->split_pending_apps, link) {
-		if (!strcmp(_app_id, split_surf->app_id)) {
-			surface->split.output = split_surf->ioutput;
-			surface->split.orientation = split_surf->orientation;
-			ivi_remove_pending_desktop_surface_split(split_surf);
-			return true;
-		}
-	}
-
-	return false;
-}
-
-static bool
-ivi_check_pending_desktop_surface_fullscreen(struct ivi_surface *surface)
+/*
+ * The remote output is only a fallback: a popup, split or fullscreen
+ * property already set for the application takes priority over it.
+ */
+void
+ivi_set_pending_desktop_surface_remote(struct ivi_output *ioutput,
+		const char *app_id)
 {
-	struct pending_fullscreen *fs_surf, *next_fs_surf;
-	struct ivi_compositor *ivi = surface->ivi;
-	const char *_app_id =
-			weston_desktop_surface_get_app_id(surface->dsurface);
-
-	if (wl_list_empty(&ivi->fullscreen_pending_apps) || !_app_id)
-		return false;
+	struct ivi_compositor *ivi = ioutput->ivi;
+	struct pending_app *papp;
 
-	wl_list_for_each_safe(fs_surf, next_fs_surf,
-			      &ivi->fullscreen_pending_apps, link) {
-		if (!strcmp(_app_id, fs_surf->app_id)) {
-			surface->fullscreen.output = fs_surf->ioutput;
-			ivi_remove_pending_desktop_surface_fullscreen(fs_surf);
-			return true;
-		}
-	}
+	papp = ivi_find_pending_app(ivi, app_id, ivi_app_id_hash(app_id));
+	if (papp && papp->role != IVI_SURFACE_ROLE_REMOTE)
+		return;
 
-	return false;
+	ivi_set_pending_app(ioutput, app_id, IVI_SURFACE_ROLE_REMOTE);
 }
 
-static bool
-ivi_check_pending_desktop_surface_remote(struct ivi_surface *surface)
+/*
+ * Drops the properties set for an output which is going away, otherwise an
+ * application started later on would be placed on a stale ivi_output.
+ */
+void
+ivi_remove_pending_desktop_surfaces(struct ivi_output *ioutput)
 {
-	struct pending_remote *remote_surf, *next_remote_surf;
-	struct ivi_compositor *ivi = surface->ivi;
-	const char *_app_id =
-		weston_desktop_surface_get_app_id(surface->dsurface);
-
-	if (wl_list_empty(&ivi->remote_pending_apps) || !_app_id)
-		return false;
-
-	wl_list_for_each_safe(remote_surf, next_remote_surf,
-			      &ivi->remote_pending_apps, link) {
-		if (!strcmp(_app_id, remote_surf->app_id)) {
-			surface->remote.output = remote_surf->ioutput;
-			ivi_remove_pending_desktop_surface_remote(remote_surf);
-			return true;
-		}
-	}
+	struct ivi_compositor *ivi = ioutput->ivi;
+	struct pending_app *papp, *next_papp;
 
-	return false;
+	for (size_t i = 0; i < IVI_APP_ID_HASH_SIZE; i++)
+		wl_list_for_each_safe(papp, next_papp,
+				      &ivi->pending_apps[i], link)
+			if (papp->ioutput == ioutput)
+				ivi_remove_pending_app(papp);
 }
 
 bool
 ivi_check_pending_surface(struct ivi_surface *surface)
 {
-	struct ivi_compositor *ivi = surface->ivi;
-	struct wl_list *role_pending_list;
-	struct pending_popup *p_popup;
-	struct pending_split *p_split;
-	struct pending_fullscreen *p_fullscreen;
-	struct pending_remote *p_remote;
-	const char *app_id =
-		weston_desktop_surface_get_app_id(surface->dsurface);
-
-	if (!app_id)
-		return false;
-
-	role_pending_list = &ivi->popup_pending_apps;
-	wl_list_for_each(p_popup, role_pending_list, link) {
-		if (!strcmp(app_id, p_popup->app_id)) {
-			return true;
-		}
-	}
-
-	role_pending_list = &ivi->split_pending_apps;
-	wl_list_for_each(p_split, role_pending_list, link) {
-		if (!strcmp(app_id, p_split->app_id)) {
-			return true;
-		}
-	}
-
-	role_pending_list = &ivi->fullscreen_pending_apps;
-	wl_list_for_each(p_fullscreen, role_pending_list, link) {
-		if (!strcmp(app_id, p_fullscreen->app_id)) {
-			return true;
-		}
-	}
-
-	role_pending_list = &ivi->remote_pending_apps;
-	wl_list_for_each(p_remote, role_pending_list, link) {
-		if (!strcmp(app_id, p_remote->app_id)) {
-			return true;
-		}
-	}
-
-	/* else, we are a regular desktop surface */
-	return false;
+	/* if not found, we are a regular desktop surface */
+	return ivi_find_pending_app(surface->ivi, surface->app_id,
+				    surface->app_id_hash) != NULL;
 }
 
-
 void
 ivi_check_pending_desktop_surface(struct ivi_surface *surface)
 {
-	bool ret = false;
+	struct pending_app *papp;
+
+	papp = ivi_find_pending_app(surface->ivi, surface->app_id,
+				    surface->app_id_hash);
+	if (!papp) {
+		/* if we end up here means we have a regular desktop app and
+		 * try to activate it */
+		ivi_set_desktop_surface(surface);
+		ivi_layout_desktop_committed(surface);
+		return;
+	}
+
+	switch (papp->role) {
+	case IVI_SURFACE_ROLE_POPUP:
+		surface->popup.output = papp->ioutput;
+		surface->popup.x = papp->popup.x;
+		surface->popup.y = papp->popup.y;
+		surface->popup.bb = papp->popup.bb;
+		ivi_remove_pending_app(papp);
 
-	ret = ivi_check_pending_desktop_surface_popup(surface);
-	if (ret) {
 		ivi_set_desktop_surface_popup(surface);
 		ivi_layout_popup_committed(surface);
-		return;
-	}
+		break;
+	case IVI_SURFACE_ROLE_SPLIT_V:
+	case IVI_SURFACE_ROLE_SPLIT_H:
+		surface->split.output = papp->ioutput;
+		surface->split.orientation = papp->split.orientation;
+		surface->split.ratio = papp->split.ratio;
+		ivi_remove_pending_app(papp);
 
-	ret = ivi_check_pending_desktop_surface_split(surface);
-	if (ret) {
 		ivi_set_desktop_surface_split(surface);
 		ivi_layout_split_committed(surface);
-		return;
-	}
+		break;
+	case IVI_SURFACE_ROLE_FULLSCREEN:
+		surface->fullscreen.output = papp->ioutput;
+		ivi_remove_pending_app(papp);
 
-	ret = ivi_check_pending_desktop_surface_fullscreen(surface);
-	if (ret) {
 		ivi_set_desktop_surface_fullscreen(surface);
 		ivi_layout_fullscreen_committed(surface);
-		return;
-	}
+		break;
+	case IVI_SURFACE_ROLE_REMOTE:
+		surface->remote.output = papp->ioutput;
+		ivi_remove_pending_app(papp);
 
-	ret = ivi_check_pending_desktop_surface_remote(surface);
-	if (ret) {
 		ivi_set_desktop_surface_remote(surface);
 		ivi_layout_desktop_committed(surface);
-		return;
-	}
+		break;
+	default:
+		ivi_remove_pending_app(papp);
 
-	/* if we end up here means we have a regular desktop app and
-	 * try to activate it */
-	ivi_set_desktop_surface(surface);
-	ivi_layout_desktop_committed(surface);
+		ivi_set_desktop_surface(surface);
+		ivi_layout_desktop_committed(surface);
+		break;
+	}
 }
 
 void
@@ -988,6 +908,7 @@ shell_activate_app(struct wl_client *client,
 	struct weston_output *woutput = weston_head_get_output(head);
 	struct ivi_output *output = to_ivi_output(woutput);
 
+	ivi_tracer_activate_request(output->ivi, app_id);
 	ivi_layout_activate(output, app_id);
 }
 
@@ -1001,6 +922,7 @@ shell_desktop_activate_app(struct wl_client *client,
 	struct weston_output *woutput = weston_head_get_output(head);
 	struct ivi_output *output = to_ivi_output(woutput);
 
+	ivi_tracer_activate_request(output->ivi, app_id);
 	ivi_layout_activate(output, app_id);
 	shell_advertise_app_state(output->ivi, app_id,
 				  data, AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED);
@@ -1048,7 +970,8 @@ shell_desktop_set_app_property(struct wl_client *client,
 		break;
 	case AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_VERTICAL:
 	case AGL_SHELL_DESKTOP_APP_ROLE_SPLIT_HORIZONTAL:
-		ivi_set_pending_desktop_surface_split(output, app_id, role);
+		/* even split, set_app_split gives the ratio */
+		ivi_set_pending_desktop_surface_split(output, app_id, role, 0);
 		break;
 	case AGL_SHELL_DESKTOP_APP_ROLE_REMOTE:
 		ivi_set_pending_desktop_surface_remote(output, app_id);
@@ -1058,10 +981,25 @@ shell_desktop_set_app_property(struct wl_client *client,
 	}
 }
 
+static void
+shell_desktop_set_app_split(struct wl_client *client,
+			    struct wl_resource *shell_res,
+			    const char *app_id, uint32_t orientation,
+			    uint32_t ratio, struct wl_resource *output_res)
+{
+	struct weston_head *head = weston_head_from_resource(output_res);
+	struct weston_output *woutput = weston_head_get_output(head);
+	struct ivi_output *output = to_ivi_output(woutput);
+
+	ivi_set_pending_desktop_surface_split(output, app_id, orientation,
+					      ratio);
+}
+
 static const struct agl_shell_desktop_interface agl_shell_desktop_implementation = {
 	.activate_app = shell_desktop_activate_app,
 	.set_app_property = shell_desktop_set_app_property,
 	.deactivate_app = shell_deactivate_app,
+	.set_app_split = shell_desktop_set_app_split,
 };
 
 static void
@@ -1088,6 +1026,8 @@ unbind_agl_shell(struct wl_resource *resource)
 	wl_list_for_each_safe(surf, surf_tmp, &ivi->surfaces, link) {
 		wl_list_remove(&surf->link);
 		wl_list_init(&surf->link);
+		ivi_app_id_index_remove(surf);
+		ivi_surface_role_untrack(surf);
 	}
 
 	wl_list_for_each_safe(surf, surf_tmp, &ivi->pending_surfaces, link) {
@@ -1211,7 +1151,7 @@ ivi_shell_create_global(struct ivi_compositor *ivi)
 	}
 
 	ivi->agl_shell_desktop = wl_global_create(ivi->compositor->wl_display,
-						  &agl_shell_desktop_interface, 1,
+						  &agl_shell_desktop_interface, 2,
 						  ivi, bind_agl_shell_desktop);
 	if (!ivi->agl_shell_desktop) {
 		weston_log("Failed to create wayland global (agl_shell_desktop).\n");
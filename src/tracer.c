@@ -0,0 +1,429 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ivi-compositor.h"
+#include "shared/helpers.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/config-parser.h>
+#include <libweston/weston-log.h>
+
+/*
+ * Measures the time it takes from an activate_app request until the first
+ * frame showing the application has been repainted, per app_id.
+ *
+ * libweston doesn't provide compositor-side presentation feedback, so the
+ * measurement is closed on the frame signal of the output, which is emitted
+ * once the frame has been rendered and submitted to the backend. This might
+ * be off by at most a vblank period compared to the actual presentation time.
+ */
+
+/* bucket i holds samples between [2^i, 2^(i + 1)) microseconds */
+#define IVI_TRACER_BUCKETS	24
+
+struct ivi_tracer_app {
+	struct ivi_tracer *tracer;
+	struct wl_list link;	/* ivi_tracer::apps */
+
+	char *app_id;
+	uint32_t app_id_hash;
+
+	/* measurement in progress, if request isn't zero */
+	struct timespec request;
+	struct timespec configure;
+	struct timespec commit;
+	struct timespec complete;
+	struct weston_output *output;
+	struct wl_listener frame_listener;
+	struct wl_listener output_destroy_listener;
+
+	uint32_t histogram[IVI_TRACER_BUCKETS];
+	uint32_t samples;
+	uint64_t min_us;
+	uint64_t max_us;
+	uint64_t total_us;
+};
+
+struct ivi_tracer {
+	struct ivi_compositor *ivi;
+	struct wl_list apps;	/* ivi_tracer_app::link */
+	int in_flight;
+
+	struct weston_log_scope *scope;
+	struct wl_event_source *dump_source;
+	char *dump_path;
+
+	struct wl_listener destroy_listener;
+};
+
+static bool
+timespec_is_zero(const struct timespec *ts)
+{
+	return ts->tv_sec == 0 && ts->tv_nsec == 0;
+}
+
+static int64_t
+timespec_sub_to_usec(const struct timespec *a, const struct timespec *b)
+{
+	if (timespec_is_zero(b))
+		return 0;
+
+	return (a->tv_sec - b->tv_sec) * 1000000LL +
+	       (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static struct ivi_tracer_app *
+ivi_tracer_find_app(struct ivi_tracer *tracer, const char *app_id,
+		    bool create)
+{
+	struct ivi_tracer_app *app;
+	uint32_t hash;
+
+	if (!app_id)
+		return NULL;
+
+	hash = ivi_app_id_hash(app_id);
+	wl_list_for_each(app, &tracer->apps, link)
+		if (app->app_id_hash == hash && !strcmp(app->app_id, app_id))
+			return app;
+
+	if (!create)
+		return NULL;
+
+	app = zalloc(sizeof(*app));
+	if (!app)
+		return NULL;
+
+	app->app_id = strdup(app_id);
+	if (!app->app_id) {
+		free(app);
+		return NULL;
+	}
+
+	app->tracer = tracer;
+	app->app_id_hash = hash;
+	app->min_us = UINT64_MAX;
+	wl_list_init(&app->frame_listener.link);
+	wl_list_init(&app->output_destroy_listener.link);
+	wl_list_insert(&tracer->apps, &app->link);
+
+	return app;
+}
+
+static void
+ivi_tracer_app_reset(struct ivi_tracer_app *app)
+{
+	if (!timespec_is_zero(&app->request))
+		app->tracer->in_flight--;
+
+	memset(&app->request, 0, sizeof(app->request));
+	memset(&app->configure, 0, sizeof(app->configure));
+	memset(&app->commit, 0, sizeof(app->commit));
+	memset(&app->complete, 0, sizeof(app->complete));
+
+	app->output = NULL;
+	wl_list_remove(&app->frame_listener.link);
+	wl_list_init(&app->frame_listener.link);
+	wl_list_remove(&app->output_destroy_listener.link);
+	wl_list_init(&app->output_destroy_listener.link);
+}
+
+static void
+ivi_tracer_app_record(struct ivi_tracer_app *app, uint64_t latency_us)
+{
+	int bucket = 0;
+
+	while (bucket < IVI_TRACER_BUCKETS - 1 &&
+	       latency_us >= (2ULL << bucket))
+		bucket++;
+
+	app->histogram[bucket]++;
+	app->samples++;
+	app->total_us += latency_us;
+	if (latency_us < app->min_us)
+		app->min_us = latency_us;
+	if (latency_us > app->max_us)
+		app->max_us = latency_us;
+}
+
+static void
+ivi_tracer_frame(struct wl_listener *listener, void *data)
+{
+	struct ivi_tracer_app *app =
+		wl_container_of(listener, app, frame_listener);
+	struct ivi_tracer *tracer = app->tracer;
+	struct timespec now;
+	int64_t latency_us;
+
+	weston_compositor_read_presentation_clock(tracer->ivi->compositor, &now);
+	latency_us = timespec_sub_to_usec(&now, &app->request);
+
+	ivi_tracer_app_record(app, latency_us);
+
+	weston_log_scope_printf(tracer->scope,
+				"app_id %s, output %s: configure %"PRId64" us, "
+				"commit %"PRId64" us, complete %"PRId64" us, "
+				"frame %"PRId64" us\n",
+				app->app_id, app->output->name,
+				timespec_sub_to_usec(&app->configure, &app->request),
+				timespec_sub_to_usec(&app->commit, &app->request),
+				timespec_sub_to_usec(&app->complete, &app->request),
+				latency_us);
+
+	ivi_tracer_app_reset(app);
+}
+
+static void
+ivi_tracer_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_tracer_app *app =
+		wl_container_of(listener, app, output_destroy_listener);
+
+	ivi_tracer_app_reset(app);
+}
+
+void
+ivi_tracer_activate_request(struct ivi_compositor *ivi, const char *app_id)
+{
+	struct ivi_tracer_app *app;
+
+	if (!ivi->tracer)
+		return;
+
+	app = ivi_tracer_find_app(ivi->tracer, app_id, true);
+	if (!app)
+		return;
+
+	/* a new request supersedes the one still in progress */
+	ivi_tracer_app_reset(app);
+
+	weston_compositor_read_presentation_clock(ivi->compositor,
+						  &app->request);
+	ivi->tracer->in_flight++;
+}
+
+static struct ivi_tracer_app *
+ivi_tracer_find_in_flight(struct ivi_surface *surf)
+{
+	struct ivi_tracer *tracer = surf->ivi->tracer;
+	struct ivi_tracer_app *app;
+
+	if (!tracer || tracer->in_flight == 0)
+		return NULL;
+
+	app = ivi_tracer_find_app(tracer, surf->app_id, false);
+	if (!app || timespec_is_zero(&app->request))
+		return NULL;
+
+	return app;
+}
+
+void
+ivi_tracer_configure(struct ivi_surface *surf)
+{
+	struct ivi_tracer_app *app = ivi_tracer_find_in_flight(surf);
+
+	if (!app || !timespec_is_zero(&app->configure))
+		return;
+
+	weston_compositor_read_presentation_clock(surf->ivi->compositor,
+						  &app->configure);
+}
+
+void
+ivi_tracer_commit(struct ivi_surface *surf)
+{
+	struct ivi_tracer_app *app = ivi_tracer_find_in_flight(surf);
+
+	/* only the first commit after the configure event */
+	if (!app || timespec_is_zero(&app->configure) ||
+	    !timespec_is_zero(&app->commit))
+		return;
+
+	weston_compositor_read_presentation_clock(surf->ivi->compositor,
+						  &app->commit);
+}
+
+void
+ivi_tracer_activate_complete(struct ivi_surface *surf,
+			     struct ivi_output *output)
+{
+	struct ivi_tracer_app *app = ivi_tracer_find_in_flight(surf);
+
+	if (!app || !timespec_is_zero(&app->complete) || !output->output)
+		return;
+
+	weston_compositor_read_presentation_clock(surf->ivi->compositor,
+						  &app->complete);
+
+	app->output = output->output;
+	app->frame_listener.notify = ivi_tracer_frame;
+	wl_signal_add(&output->output->frame_signal, &app->frame_listener);
+	app->output_destroy_listener.notify = ivi_tracer_output_destroy;
+	weston_output_add_destroy_listener(output->output,
+					   &app->output_destroy_listener);
+}
+
+static void
+ivi_tracer_dump(struct ivi_tracer *tracer, FILE *fp)
+{
+	struct ivi_tracer_app *app;
+
+	wl_list_for_each(app, &tracer->apps, link) {
+		if (app->samples == 0)
+			continue;
+
+		fprintf(fp, "app_id %s: samples %u, min %"PRIu64" us, "
+			"avg %"PRIu64" us, max %"PRIu64" us\n",
+			app->app_id, app->samples, app->min_us,
+			app->total_us / app->samples, app->max_us);
+
+		for (int i = 0; i < IVI_TRACER_BUCKETS; i++) {
+			if (app->histogram[i] == 0)
+				continue;
+
+			fprintf(fp, "\t[%10llu, %10llu) us: %u\n",
+				i == 0 ? 0ULL : 1ULL << i, 2ULL << i,
+				app->histogram[i]);
+		}
+	}
+}
+
+static void
+ivi_tracer_subscribe(struct weston_log_subscription *sub, void *data)
+{
+	struct ivi_tracer *tracer = data;
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp;
+
+	fp = open_memstream(&buf, &len);
+	if (!fp)
+		return;
+
+	ivi_tracer_dump(tracer, fp);
+	fclose(fp);
+
+	if (len > 0)
+		weston_log_subscription_printf(sub, "%s", buf);
+	free(buf);
+}
+
+static int
+ivi_tracer_dump_on_signal(int signal_number, void *data)
+{
+	struct ivi_tracer *tracer = data;
+	FILE *fp;
+
+	fp = fopen(tracer->dump_path, "w");
+	if (!fp) {
+		weston_log("Failed to open activation trace file %s: %s\n",
+			   tracer->dump_path, strerror(errno));
+		return 0;
+	}
+
+	ivi_tracer_dump(tracer, fp);
+	fclose(fp);
+
+	weston_log("Activation latencies written to %s\n", tracer->dump_path);
+	return 0;
+}
+
+static void
+ivi_tracer_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_tracer *tracer =
+		container_of(listener, struct ivi_tracer, destroy_listener);
+	struct ivi_tracer_app *app, *app_tmp;
+
+	wl_list_remove(&tracer->destroy_listener.link);
+
+	wl_list_for_each_safe(app, app_tmp, &tracer->apps, link) {
+		ivi_tracer_app_reset(app);
+		wl_list_remove(&app->link);
+		free(app->app_id);
+		free(app);
+	}
+
+	if (tracer->dump_source)
+		wl_event_source_remove(tracer->dump_source);
+	weston_compositor_log_scope_destroy(tracer->scope);
+
+	tracer->ivi->tracer = NULL;
+	free(tracer->dump_path);
+	free(tracer);
+}
+
+void
+ivi_tracer_create(struct ivi_compositor *ivi)
+{
+	struct weston_compositor *ec = ivi->compositor;
+	struct wl_event_loop *loop = wl_display_get_event_loop(ec->wl_display);
+	struct weston_config_section *section;
+	struct ivi_tracer *tracer;
+
+	tracer = zalloc(sizeof(*tracer));
+	if (!tracer)
+		return;
+
+	tracer->ivi = ivi;
+	wl_list_init(&tracer->apps);
+
+	section = weston_config_get_section(ivi->config, "core", NULL, NULL);
+	weston_config_section_get_string(section, "activation-trace-file",
+					 &tracer->dump_path, NULL);
+	if (!tracer->dump_path) {
+		const char *dir = getenv("XDG_RUNTIME_DIR");
+
+		if (asprintf(&tracer->dump_path, "%s/agl-compositor-activation.txt",
+			     dir ? dir : "/tmp") < 0)
+			tracer->dump_path = NULL;
+	}
+
+	tracer->scope =
+		weston_compositor_add_log_scope(ec->weston_log_ctx,
+						"activation-trace",
+						"activate_app request to first frame latency, "
+						"per app_id\n",
+						ivi_tracer_subscribe, NULL, tracer);
+
+	if (tracer->dump_path)
+		tracer->dump_source =
+			wl_event_loop_add_signal(loop, SIGUSR1,
+						 ivi_tracer_dump_on_signal, tracer);
+
+	tracer->destroy_listener.notify = ivi_tracer_destroy;
+	wl_signal_add(&ec->destroy_signal, &tracer->destroy_listener);
+
+	ivi->tracer = tracer;
+}